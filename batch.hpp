@@ -0,0 +1,387 @@
+#pragma once
+
+#include "model.hpp"
+
+namespace IOSKJ {
+
+/**
+ * A batch of `Lanes` models which are updated in lockstep.
+ *
+ * `Model::update()` works on small arrays (e.g. 3 regions x 24 ages) so loop and
+ * call overheads dominate. This class holds the state of several replicates in a
+ * structure-of-arrays layout with the lane (replicate) as the innermost, contiguous,
+ * dimension so that the loops over lanes in `update()` can be vectorised by the
+ * compiler (e.g. compile with `CXX_ARCH=-mavx2`).
+ *
+ * Each lane is paired with a scalar `Model` which is used for initialisation and
+ * for setting inputs (e.g. using `Parameters::set()` or `Procedure::operate()`).
+ * The usual pattern for each time step is:
+ *
+ *   - `load()` each lane after `Model::initialise()` (or from an existing model)
+ *   - `inputs()` each lane after its model's inputs (e.g. catches) have been set
+ *   - `update()` all lanes
+ *   - `store()` each lane back into its model for data, tracking etc
+ *
+ * The dynamics are the same, operation for operation, as in `Model::update()`
+ * so each lane gives exactly the same results as the corresponding scalar model.
+ */
+template<uint Lanes>
+class ModelBatch {
+public:
+
+	typedef decltype(Model::exploit) Exploit;
+
+	/**
+	 * @{
+	 * @name Time invariant variables (set by `load()`)
+	 */
+
+	double weight_age[ages_size][Lanes];
+	double maturity_age[ages_size][Lanes];
+	double survival[ages_size][Lanes];
+	double movement_age[ages_size][Lanes];
+	double movement_region[regions_size][regions_size][Lanes];
+	double selectivity_age[methods_size][ages_size][Lanes];
+	double spawning[quarters_size][Lanes];
+	double recruits_unfished[regions_size][Lanes];
+	double biomass_spawning_unfished[regions_size][quarters_size][Lanes];
+	double recruits_steepness[Lanes];
+	double recruits_autocorr[Lanes];
+	double recruits_sd[Lanes];
+	Normal recruits_distrib[Lanes];
+
+	/**
+	 * Replicate number of each lane used for addressing recruitment
+	 * random number streams
+	 */
+	uint32_t replicate[Lanes];
+
+	//! @}
+
+	/**
+	 * @{
+	 * @name Time varying inputs (set by `inputs()`)
+	 */
+
+	Exploit exploit[Lanes];
+	bool recruits_relation_on[Lanes];
+	bool recruits_variation_on[Lanes];
+	double catches[regions_size][methods_size][Lanes];
+	double effort[regions_size][methods_size][Lanes];
+	double exploitation_rate_specified[regions_size][methods_size][Lanes];
+
+	//! @}
+
+	/**
+	 * @{
+	 * @name State (retrieved by `store()`)
+	 */
+
+	double numbers[regions_size][ages_size][Lanes];
+	double biomass[regions_size][Lanes];
+	double biomass_spawners[regions_size][Lanes];
+	double biomass_spawning[regions_size][quarters_size][Lanes];
+	double recruits_determ[regions_size][Lanes];
+	double recruits[regions_size][Lanes];
+	double recruits_deviation[Lanes];
+	double recruits_multiplier[Lanes];
+	double biomass_vulnerable[regions_size][methods_size][Lanes];
+	double cpue[regions_size][methods_size][Lanes];
+	GeometricMean cpue_base[regions_size][methods_size][Lanes];
+	double catchability[regions_size][methods_size][Lanes];
+	GeometricMean catchability_estim[regions_size][methods_size][Lanes];
+	double exploitation_rate[regions_size][methods_size][Lanes];
+	double catches_taken[regions_size][methods_size][Lanes];
+	double escapement[regions_size][ages_size][Lanes];
+
+	//! @}
+
+	/**
+	 * Load a lane from a model (all variables)
+	 *
+	 * @param replicate Replicate whose random number streams are used for recruitment
+	 *                  variation in the lane (as for `Model::update()`)
+	 */
+	void load(uint lane, const Model& model, uint32_t replicate){
+		for(uint age=0;age<ages_size;age++){
+			weight_age[age][lane] = model.weight_age(age);
+			maturity_age[age][lane] = model.maturity_age(age);
+			survival[age][lane] = model.survival(age);
+			movement_age[age][lane] = model.movement_age(age);
+			for(uint method=0;method<methods_size;method++){
+				selectivity_age[method][age][lane] = model.selectivity_age(method,age);
+			}
+		}
+		for(uint region_from=0;region_from<regions_size;region_from++){
+			for(uint region=0;region<regions_size;region++){
+				movement_region[region_from][region][lane] = model.movement_region(region_from,region);
+			}
+		}
+		for(uint quarter=0;quarter<quarters_size;quarter++){
+			spawning[quarter][lane] = model.spawning(quarter);
+		}
+		for(uint region=0;region<regions_size;region++){
+			recruits_unfished[region][lane] = model.recruits_unfished(region);
+			for(uint quarter=0;quarter<quarters_size;quarter++){
+				biomass_spawning_unfished[region][quarter][lane] = model.biomass_spawning_unfished(region,quarter);
+			}
+		}
+		recruits_steepness[lane] = model.recruits_steepness;
+		recruits_autocorr[lane] = model.recruits_autocorr;
+		recruits_sd[lane] = model.recruits_sd;
+		recruits_distrib[lane] = model.recruits_distrib;
+		this->replicate[lane] = replicate;
+
+		for(uint region=0;region<regions_size;region++){
+			biomass[region][lane] = model.biomass(region);
+			biomass_spawners[region][lane] = model.biomass_spawners(region);
+			recruits_determ[region][lane] = model.recruits_determ(region);
+			recruits[region][lane] = model.recruits(region);
+			for(uint quarter=0;quarter<quarters_size;quarter++){
+				biomass_spawning[region][quarter][lane] = model.biomass_spawning(region,quarter);
+			}
+			for(uint age=0;age<ages_size;age++){
+				numbers[region][age][lane] = model.numbers(region,age);
+				escapement[region][age][lane] = model.escapement(region,age);
+			}
+			for(uint method=0;method<methods_size;method++){
+				biomass_vulnerable[region][method][lane] = model.biomass_vulnerable(region,method);
+				cpue[region][method][lane] = model.cpue(region,method);
+				cpue_base[region][method][lane] = model.cpue_base(region,method);
+				catchability[region][method][lane] = model.catchability(region,method);
+				catchability_estim[region][method][lane] = model.catchability_estim(region,method);
+				exploitation_rate[region][method][lane] = model.exploitation_rate(region,method);
+				catches_taken[region][method][lane] = model.catches_taken(region,method);
+			}
+		}
+		recruits_deviation[lane] = model.recruits_deviation;
+		recruits_multiplier[lane] = model.recruits_multiplier;
+
+		inputs(lane,model);
+	}
+
+	/**
+	 * Load the time varying inputs for a lane from a model
+	 */
+	void inputs(uint lane, const Model& model){
+		exploit[lane] = model.exploit;
+		recruits_relation_on[lane] = model.recruits_relation_on;
+		recruits_variation_on[lane] = model.recruits_variation_on;
+		// When recruitment variation is on the multiplier is state calculated in `update()`,
+		// otherwise it is an input
+		if(not model.recruits_variation_on) recruits_multiplier[lane] = model.recruits_multiplier;
+		for(uint region=0;region<regions_size;region++){
+			for(uint method=0;method<methods_size;method++){
+				catches[region][method][lane] = model.catches(region,method);
+				effort[region][method][lane] = model.effort(region,method);
+				exploitation_rate_specified[region][method][lane] = model.exploitation_rate_specified(region,method);
+			}
+		}
+	}
+
+	/**
+	 * Store the state of a lane into a model
+	 */
+	void store(uint lane, Model& model) const {
+		for(uint region=0;region<regions_size;region++){
+			model.biomass(region) = biomass[region][lane];
+			model.biomass_spawners(region) = biomass_spawners[region][lane];
+			model.recruits_determ(region) = recruits_determ[region][lane];
+			model.recruits(region) = recruits[region][lane];
+			for(uint quarter=0;quarter<quarters_size;quarter++){
+				model.biomass_spawning(region,quarter) = biomass_spawning[region][quarter][lane];
+			}
+			for(uint age=0;age<ages_size;age++){
+				model.numbers(region,age) = numbers[region][age][lane];
+				model.escapement(region,age) = escapement[region][age][lane];
+			}
+			for(uint method=0;method<methods_size;method++){
+				model.biomass_vulnerable(region,method) = biomass_vulnerable[region][method][lane];
+				model.cpue(region,method) = cpue[region][method][lane];
+				model.cpue_base(region,method) = cpue_base[region][method][lane];
+				model.catchability(region,method) = catchability[region][method][lane];
+				model.catchability_estim(region,method) = catchability_estim[region][method][lane];
+				model.exploitation_rate(region,method) = exploitation_rate[region][method][lane];
+				model.catches_taken(region,method) = catches_taken[region][method][lane];
+			}
+		}
+		model.recruits_deviation = recruits_deviation[lane];
+		model.recruits_multiplier = recruits_multiplier[lane];
+	}
+
+	/**
+	 * Perform a single time step for all lanes
+	 *
+	 * See `Model::update()` for a description of each step
+	 */
+	void update(uint time){
+		uint year = IOSKJ::year(time);
+		uint quarter = IOSKJ::quarter(time);
+
+		// Calculate total biomass, spawners biomass and spawning biomass by region
+		for(uint region=0;region<regions_size;region++){
+			double biomass_[Lanes] = {};
+			double biomass_spawners_[Lanes] = {};
+			double biomass_spawning_[Lanes] = {};
+			for(uint age=0;age<ages_size;age++){
+				for(uint lane=0;lane<Lanes;lane++){
+					double biomass = numbers[region][age][lane] * weight_age[age][lane]/1000;
+					biomass_[lane] += biomass;
+					double spawners = biomass * maturity_age[age][lane];
+					biomass_spawners_[lane] += spawners;
+					biomass_spawning_[lane] += spawners * spawning[quarter][lane];
+				}
+			}
+			for(uint lane=0;lane<Lanes;lane++){
+				biomass[region][lane] = biomass_[lane];
+				biomass_spawners[region][lane] = biomass_spawners_[lane];
+				biomass_spawning[region][quarter][lane] = biomass_spawning_[lane];
+			}
+		}
+
+		// Ageing and recruitment
+		for(uint region=0;region<regions_size;region++){
+			for(uint lane=0;lane<Lanes;lane++){
+				if(recruits_relation_on[lane]){
+					recruits_determ[region][lane] = Model::recruits_relation(
+						recruits_steepness[lane],recruits_unfished[region][lane],
+						biomass_spawning_unfished[region][quarter][lane],biomass_spawning[region][quarter][lane]
+					);
+				} else {
+					recruits_determ[region][lane] = recruits_unfished[region][lane];
+				}
+			}
+			if(quarter==0){
+				for(uint lane=0;lane<Lanes;lane++){
+					if(recruits_variation_on[lane]){
+						// As in `Model::update()` a deviation is drawn for each region
+						// from the start of the stream for the lane and time
+						if(region==0) streams_[lane] = Generator.stream(replicate[lane],0,time,purpose_recruitment);
+						Model::recruits_vary(
+							recruits_deviation[lane],recruits_multiplier[lane],
+							recruits_autocorr[lane],recruits_sd[lane],recruits_distrib[lane],streams_[lane]
+						);
+					}
+				}
+			}
+			for(uint lane=0;lane<Lanes;lane++){
+				recruits[region][lane] = recruits_determ[region][lane] * recruits_multiplier[lane];
+			}
+
+			for(uint lane=0;lane<Lanes;lane++){
+				numbers[region][ages_size-1][lane] += numbers[region][ages_size-2][lane];
+			}
+			for(uint age=ages_size-2;age>0;age--){
+				for(uint lane=0;lane<Lanes;lane++){
+					numbers[region][age][lane] = numbers[region][age-1][lane];
+				}
+			}
+			for(uint lane=0;lane<Lanes;lane++){
+				numbers[region][0][lane] = recruits[region][lane];
+			}
+		}
+
+		// Natural mortality
+		for(uint region=0;region<regions_size;region++){
+			for(uint age=0;age<ages_size;age++){
+				for(uint lane=0;lane<Lanes;lane++){
+					numbers[region][age][lane] *= survival[age][lane];
+				}
+			}
+		}
+
+		// Movement
+		for(uint region_from=0;region_from<regions_size;region_from++){
+			for(uint region_to=0;region_to<regions_size;region_to++){
+				for(uint age=0;age<ages_size;age++){
+					for(uint lane=0;lane<Lanes;lane++){
+						double movers =
+							numbers[region_from][age][lane] *
+							movement_region[region_from][region_to][lane] *
+							movement_age[age][lane];
+						numbers[region_from][age][lane] -= movers;
+						numbers[region_to][age][lane] += movers;
+					}
+				}
+			}
+		}
+
+		// Fishing mortality
+		for(uint region=0;region<regions_size;region++){
+			for(uint method=0;method<methods_size;method++){
+				// Calculate vulnerable biomass
+				double biomass_vuln[Lanes] = {};
+				for(uint age=0;age<ages_size;age++){
+					for(uint lane=0;lane<Lanes;lane++){
+						biomass_vuln[lane] += numbers[region][age][lane] *
+						                      weight_age[age][lane]/1000 *
+						                      selectivity_age[method][age][lane];
+					}
+				}
+				for(uint lane=0;lane<Lanes;lane++){
+					if(exploit[lane]==Model::exploit_none) continue;
+					exploit_(lane,year,quarter,region,method,biomass_vuln[lane]);
+				}
+			}
+		}
+		for(uint region=0;region<regions_size;region++){
+			for(uint age=0;age<ages_size;age++){
+				double proportion_taken[Lanes] = {};
+				for(uint method=0;method<methods_size;method++){
+					for(uint lane=0;lane<Lanes;lane++){
+						proportion_taken[lane] += exploitation_rate[region][method][lane] * selectivity_age[method][age][lane];
+					}
+				}
+				for(uint lane=0;lane<Lanes;lane++){
+					if(exploit[lane]==Model::exploit_none) escapement[region][age][lane] = 1;
+					else escapement[region][age][lane] = (proportion_taken[lane]>1)?0:(1-proportion_taken[lane]);
+				}
+			}
+		}
+		// Apply escapement
+		for(uint region=0;region<regions_size;region++){
+			for(uint age=0;age<ages_size;age++){
+				for(uint lane=0;lane<Lanes;lane++){
+					numbers[region][age][lane] *= escapement[region][age][lane];
+				}
+			}
+		}
+	}
+
+private:
+
+	/**
+	 * Recruitment random number streams for each lane
+	 */
+	Philox streams_[Lanes];
+
+	/**
+	 * Update CPUE and determine the exploitation rate for a lane, region and method
+	 */
+	void exploit_(uint lane, uint year, uint quarter, uint region, uint method, double biomass_vuln){
+		biomass_vulnerable[region][method][lane] = biomass_vuln;
+
+		// Update CPUE
+		if(quarter==0) Model::cpue_step(year,cpue_base[region][method][lane],cpue[region][method][lane],biomass_vuln);
+
+		// Determine exploitation rate
+		double er = 0;
+		if(exploit[lane]==Model::exploit_catch){
+			er = Model::exploitation_rate_catch(catches[region][method][lane],biomass_vuln);
+			// Update estimate of catchability (only during the estimation period)
+			double e = effort[region][method][lane];
+			if(year>=2005 and year<=2014 and e>0){
+				Model::catchability_step(year,catchability_estim[region][method][lane],catchability[region][method][lane],er/e);
+			}
+		}
+		else if(exploit[lane]==Model::exploit_effort){
+			er = catchability[region][method][lane] * effort[region][method][lane];
+		} else {
+			er = exploitation_rate_specified[region][method][lane];
+		}
+		exploitation_rate[region][method][lane] = er;
+		catches_taken[region][method][lane] = er * biomass_vuln;
+	}
+};
+
+} // namespace IOSKJ
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "imports.hpp"
+#include "dimensions.hpp"
+
+namespace IOSKJ {
+
+/**
+ * A binary bundle of the parsed model inputs
+ *
+ * Every process (including each of the many processes started for a conditioning or evaluation run)
+ * otherwise parses the same JSON and TSV files in `parameters/input` and `data/input`. The `bundle` task
+ * parses them once and writes the resulting objects as raw bytes into a single file which is memory mapped
+ * when it is opened so that `Parameters::read()`, `Data::read()` and `CatchHistory` simply copy them.
+ *
+ * The file is a `Header`, followed by an `Entry` (offset and size) for each `Section`, followed by the sections.
+ * The header includes a hash of the input files so that a bundle is not used if those have changed since it
+ * was built. A section is also not used if its size differs from that of the object it is copied into
+ * (e.g. because the code has changed) in which case the object is read from the input files as usual.
+ */
+class Bundle {
+public:
+
+	/**
+	 * Sections of the bundle
+	 */
+	enum Section {
+		parameters,
+		catches,
+		m_pl_cpue,
+		w_ps_cpue,
+		z_ests,
+		size_freqs_strata,
+		size_freqs_proportions,
+		size_freqs_samples,
+		sections
+	};
+
+	/**
+	 * Path of the bundle
+	 */
+	static std::string path(void){
+		return "inputs.bundle";
+	}
+
+	/**
+	 * The bundle opened by this process
+	 *
+	 * The bundle is opened on first use and shared by all threads.
+	 */
+	static const Bundle& opened(void){
+		static Bundle bundle(path());
+		return bundle;
+	}
+
+	/**
+	 * Writes sections to a new bundle
+	 */
+	class Writer {
+	public:
+
+		template<class Type>
+		void add(Section section, const Type& object){
+			static_assert(
+				std::is_trivially_copyable<Type>::value,
+				"Objects are stored in the bundle as raw bytes so must be trivially copyable"
+			);
+			add(section,&object,sizeof(Type));
+		}
+
+		template<class Type>
+		void add(Section section, const std::vector<Type>& vector){
+			static_assert(
+				std::is_trivially_copyable<Type>::value,
+				"Objects are stored in the bundle as raw bytes so must be trivially copyable"
+			);
+			add(section,vector.data(),vector.size()*sizeof(Type));
+		}
+
+		void add(Section section, const void* bytes, uint64_t size){
+			const char* start = static_cast<const char*>(bytes);
+			bytes_[section].assign(start,start+size);
+		}
+
+		/**
+		 * Write the bundle (via a temporary file so that other processes never see a partial bundle)
+		 */
+		void write(const std::string& path = Bundle::path()) const {
+			Header header = header_make();
+			Entry entries[sections];
+			uint64_t offset = sizeof(Header)+sizeof(entries);
+			for(uint section=0;section<sections;section++){
+				entries[section].offset = offset;
+				entries[section].size = bytes_[section].size();
+				// Keep sections 8 byte aligned
+				offset += (bytes_[section].size()+7)/8*8;
+			}
+
+			std::string temp = path+".tmp";
+			{
+				std::ofstream file(temp,std::ios::binary);
+				file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+				file.write(reinterpret_cast<const char*>(entries),sizeof(entries));
+				for(uint section=0;section<sections;section++){
+					const auto& bytes = bytes_[section];
+					file.write(bytes.data(),bytes.size());
+					file.write("\0\0\0\0\0\0\0",(8-bytes.size()%8)%8);
+				}
+				if(not file.good()) throw std::runtime_error("Error writing bundle: "+temp);
+			}
+			boost::filesystem::rename(temp,path);
+		}
+
+	private:
+		std::vector<char> bytes_[sections];
+	};
+
+	/**
+	 * Open a bundle
+	 *
+	 * If the bundle does not exist, or is out of date, then `valid()` will be false.
+	 */
+	explicit Bundle(const std::string& path){
+		if(not boost::filesystem::exists(path)) return;
+		if(boost::filesystem::file_size(path)<sizeof(Header)+sections*sizeof(Entry)) return;
+
+		using namespace boost::interprocess;
+		file_ = file_mapping(path.c_str(),read_only);
+		region_ = mapped_region(file_,read_only);
+
+		const Header& header = *static_cast<const Header*>(region_.get_address());
+		Header expected = header_make();
+		if(not(
+			std::memcmp(header.magic,expected.magic,sizeof(header.magic))==0 and
+			header.version==expected.version and
+			header.sections==expected.sections and
+			header.inputs_hash==expected.inputs_hash
+		)) return;
+		const Entry* entries = reinterpret_cast<const Entry*>(header_address_()+sizeof(Header));
+		for(uint section=0;section<sections;section++){
+			if(entries[section].offset+entries[section].size>region_.get_size()) return;
+		}
+		entries_ = entries;
+	}
+
+	Bundle(const Bundle&) = delete;
+	Bundle& operator=(const Bundle&) = delete;
+
+	/**
+	 * Is the bundle valid (i.e. it exists and is up to date)?
+	 */
+	bool valid(void) const {
+		return entries_;
+	}
+
+	/**
+	 * Copy a section into an object
+	 *
+	 * @returns `false` if the bundle is not valid or the section is not the size of the object
+	 */
+	template<class Type>
+	bool get(Section section, Type& object) const {
+		static_assert(
+			std::is_trivially_copyable<Type>::value,
+			"Objects are stored in the bundle as raw bytes so must be trivially copyable"
+		);
+		if(not valid() or entries_[section].size!=sizeof(Type)) return false;
+		std::memcpy(static_cast<void*>(&object),header_address_()+entries_[section].offset,sizeof(Type));
+		return true;
+	}
+
+	/**
+	 * Copy a section into a vector
+	 *
+	 * @returns `false` if the bundle is not valid or the section is not a whole number of elements
+	 */
+	template<class Type>
+	bool get(Section section, std::vector<Type>& vector) const {
+		if(not valid() or entries_[section].size%sizeof(Type)!=0) return false;
+		const Type* start = reinterpret_cast<const Type*>(header_address_()+entries_[section].offset);
+		vector.assign(start,start+entries_[section].size/sizeof(Type));
+		return true;
+	}
+
+private:
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t sections;
+		uint64_t inputs_hash;
+	};
+
+	struct Entry {
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	static Header header_make(void){
+		Header header;
+		std::memcpy(header.magic,"IOSKJBND",8);
+		header.version = 2;
+		header.sections = sections;
+		// FNV-1a hash of input files
+		uint64_t hash = 14695981039346656037ull;
+		for(std::string input : {
+			"parameters/input/parameters.json",
+			"parameters/input/recruits_deviations.tsv",
+			"parameters/input/selectivities.tsv",
+			"parameters/input/catches.tsv",
+			"data/input/m_pl_cpue.tsv",
+			"data/input/w_ps_cpue.tsv",
+			"data/input/z_ests.tsv",
+			"data/input/size_freqs.tsv"
+		}){
+			std::ifstream file(input,std::ios::binary);
+			char buffer[65536];
+			while(file.read(buffer,sizeof(buffer)) or file.gcount()>0){
+				for(std::streamsize index=0;index<file.gcount();index++){
+					hash ^= static_cast<unsigned char>(buffer[index]);
+					hash *= 1099511628211ull;
+				}
+			}
+		}
+		header.inputs_hash = hash;
+		return header;
+	}
+
+	const char* header_address_(void) const {
+		return static_cast<const char*>(region_.get_address());
+	}
+
+	boost::interprocess::file_mapping file_;
+	boost::interprocess::mapped_region region_;
+	const Entry* entries_ = nullptr;
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "imports.hpp"
+#include "dimensions.hpp"
+#include "bundle.hpp"
+
+namespace IOSKJ {
+
+/**
+ * Historical catches by year, quarter, region and method
+ *
+ * The catch history is read once per process (from `parameters/input/catches.tsv` or the input bundle) into a
+ * read-only table which is shared, rather than copied, by all instances (e.g. the copies of `Parameters` for each
+ * worker thread and the `HistCatch` procedure). The table is read on first use, not on construction, so that
+ * creating a `Parameters` (e.g. to get its layout) does not read the catches. Missing catches are zero. The catches for each region and method
+ * in a quarter are contiguous so that they can be copied to a model in one step (see `quarter()`).
+ */
+class CatchHistory {
+public:
+
+	typedef Array<double,Year,Quarter,Region,Method> Table;
+
+	/**
+	 * Get the catch for a year, quarter, region and method
+	 */
+	double operator()(uint year, uint quarter, uint region, uint method) const {
+		return shared_()(year,quarter,region,method);
+	}
+
+	/**
+	 * Get the catches for each region and method in a quarter
+	 * (`regions_size*methods_size` values in the same order as `Model::catches`)
+	 */
+	const double* quarter(uint year, uint quarter) const {
+		return &shared_()(year,quarter,0u,0u);
+	}
+
+	/**
+	 * Get the table
+	 */
+	const Table& table(void) const {
+		return shared_();
+	}
+
+	void write(const std::string& path) const {
+		shared_().write(path,true);
+	}
+
+private:
+
+	/**
+	 * The table shared by all instances (read on first call)
+	 */
+	static const Table& shared_(void){
+		static const std::unique_ptr<const Table> table(read_());
+		return *table;
+	}
+
+	static Table* read_(void){
+		Table* table = new Table;
+		if(not Bundle::opened().get(Bundle::catches,*table)){
+			*table = 0.0;
+			table->read("parameters/input/catches.tsv",true);
+			for(auto& catche : *table){
+				if(std::isnan(catche)) catche = 0;
+			}
+		}
+		return table;
+	}
+};
+
+}
@@ -2,37 +2,285 @@
 
 #include "model.hpp"
 #include "variable.hpp"
+#include "bundle.hpp"
 
 namespace IOSKJ {
 
+/**
+ * Geometric mean of values of an automatic differentiation type
+ *
+ * Specialised to use `Stencila::GeometricMean` for doubles.
+ */
+template<class Scalar>
+class ScalarGeometricMean {
+public:
+	void append(const Scalar& value){
+		sum_ += log(value);
+		count_++;
+	}
+
+	Scalar result(void) const {
+		return exp(sum_/double(count_));
+	}
+
+	template<class Values>
+	static Scalar of(const Values& values){
+		ScalarGeometricMean mean;
+		for(const auto& value : values) mean.append(value);
+		return mean.result();
+	}
+
+private:
+	Scalar sum_ = 0;
+	uint count_ = 0;
+};
+
+template<>
+class ScalarGeometricMean<double> : public GeometricMean {
+public:
+	template<class Values>
+	static double of(const Values& values){
+		return geomean(values);
+	}
+};
+
+/**
+ * Size frequency observations
+ *
+ * Only about one in ten year/quarter/region/method strata have a size frequency observation. So, rather
+ * than a dense array, observations are held in an index of observed strata sorted by year, quarter, region and method
+ * with contiguous observed proportions and sample sizes (one for each size class, with `NAN` for size classes
+ * which are not observed). Observations do not change after they are read so they are shared by copies of `DataType`.
+ */
+class SizeFreqObservations {
+public:
+
+	struct Stratum {
+		uint year;
+		uint quarter;
+		uint region;
+		uint method;
+	};
+
+	/**
+	 * Observed strata
+	 */
+	std::vector<Stratum> strata;
+
+	/**
+	 * Observed proportions and sample sizes for the size classes of
+	 * each stratum (starting at `stratum*sizes_size`)
+	 */
+	std::vector<double> proportions;
+	std::vector<double> samples;
+
+	/**
+	 * Sum of the maximum of each log-likelihood term (see `DataType::loglike_bound()`) for each stratum
+	 */
+	std::vector<double> maxima;
+
+	/**
+	 * Maximum effective sample size
+	 */
+	double max_size = 30;
+
+	/**
+	 * Read observations from a file with columns `year`, `quarter`, `region`, `method`, `class`, `proportion` and `size`
+	 */
+	void read(const std::string& path){
+		std::ifstream file(path);
+		if(not file.good()) throw std::runtime_error("Unable to open size frequencies: "+path);
+
+		struct Row {
+			Stratum stratum;
+			uint size;
+			double proportion;
+			double sample;
+		};
+		std::vector<Row> rows;
+		std::string line;
+		std::getline(file,line);
+		while(std::getline(file,line)){
+			if(line.length()==0) continue;
+			std::istringstream stream(line);
+			Row row;
+			stream>>row.stratum.year>>row.stratum.quarter>>row.stratum.region>>row.stratum.method>>row.size>>row.proportion>>row.sample;
+			if(
+				not stream or
+				row.stratum.year<data_years.begin() or row.stratum.year>=data_years.end() or
+				row.stratum.quarter>=quarters.size() or row.stratum.region>=regions.size() or
+				row.stratum.method>=methods.size() or row.size>=sizes_size
+			) throw std::runtime_error("Error reading size frequencies: "+path+": "+line);
+			rows.push_back(row);
+		}
+		std::stable_sort(rows.begin(),rows.end(),[](const Row& a, const Row& b){
+			return before_(a.stratum,b.stratum);
+		});
+
+		strata.clear();
+		proportions.clear();
+		samples.clear();
+		for(const auto& row : rows){
+			if(strata.size()==0 or before_(strata.back(),row.stratum)){
+				strata.push_back(row.stratum);
+				proportions.resize(strata.size()*sizes_size,NAN);
+				samples.resize(strata.size()*sizes_size,NAN);
+			}
+			uint index = (strata.size()-1)*sizes_size+row.size;
+			proportions[index] = row.proportion;
+			samples[index] = row.sample;
+		}
+		maxima_calc_();
+	}
+
+	/**
+	 * Read observations from the input bundle
+	 *
+	 * @returns `false` if the bundle is not valid
+	 */
+	bool read(const Bundle& bundle){
+		if(not(
+			bundle.get(Bundle::size_freqs_strata,strata) and
+			bundle.get(Bundle::size_freqs_proportions,proportions) and
+			bundle.get(Bundle::size_freqs_samples,samples) and
+			proportions.size()==strata.size()*sizes_size and
+			samples.size()==strata.size()*sizes_size
+		)) return false;
+		maxima_calc_();
+		return true;
+	}
+
+	/**
+	 * Add observations to an input bundle
+	 */
+	void write(Bundle::Writer& writer) const {
+		writer.add(Bundle::size_freqs_strata,strata);
+		writer.add(Bundle::size_freqs_proportions,proportions);
+		writer.add(Bundle::size_freqs_samples,samples);
+	}
+
+	/**
+	 * Get the range of strata, `[first,last)`, observed in a quarter
+	 */
+	std::pair<uint,uint> range(uint year, uint quarter) const {
+		Stratum start = {year,quarter,0,0};
+		Stratum end = {year,quarter+1,0,0};
+		auto first = std::lower_bound(strata.begin(),strata.end(),start,before_);
+		auto last = std::lower_bound(first,strata.end(),end,before_);
+		return {first-strata.begin(),last-strata.begin()};
+	}
+
+	/**
+	 * Get the distribution of an observation
+	 */
+	FournierRobustifiedMultivariateNormal distribution(uint index) const {
+		return FournierRobustifiedMultivariateNormal(proportions[index],samples[index],max_size);
+	}
+
+	/**
+	 * Log-likelihood of the expected size composition for a stratum
+	 * (terms are zero if the size class is not observed or the expected proportion is missing)
+	 */
+	template<class Scalar>
+	Scalar loglike(uint stratum, const Scalar* expected) const {
+		Scalar loglike = 0;
+		for(uint size=0;size<sizes_size;size++){
+			auto distribution = this->distribution(stratum*sizes_size+size);
+			if(not std::isnan(scalar_value(expected[size])) and distribution.valid()){
+				loglike += distribution.loglike(expected[size]);
+			}
+		}
+		return loglike;
+	}
+
+	/**
+	 * Log-likelihood of the expected size composition for a stratum (for `double`s
+	 * using the block likelihood of `FournierRobustifiedMultivariateNormal`)
+	 */
+	double loglike(uint stratum, const double* expected) const {
+		uint start = stratum*sizes_size;
+		return FournierRobustifiedMultivariateNormal::loglike(
+			sizes_size,&proportions[start],&samples[start],expected,max_size
+		);
+	}
+
+private:
+
+	static bool before_(const Stratum& a, const Stratum& b){
+		if(a.year!=b.year) return a.year<b.year;
+		if(a.quarter!=b.quarter) return a.quarter<b.quarter;
+		if(a.region!=b.region) return a.region<b.region;
+		return a.method<b.method;
+	}
+
+	void maxima_calc_(void){
+		maxima.assign(strata.size(),0);
+		for(uint stratum=0;stratum<strata.size();stratum++){
+			for(uint size=0;size<sizes_size;size++){
+				auto distribution = this->distribution(stratum*sizes_size+size);
+				if(distribution.valid()) maxima[stratum] += std::max(distribution.loglike_max(),0.0);
+			}
+		}
+	}
+};
+
 /**
  * Data against which the model is conditioned
  * 
  * See the `get()` method which "gets" model variables corresponding to data at specific times.
+ *
+ * Like `ModelType`, templated on the type used for model predictions so that the log-likelihood
+ * can be differentiated. Use the `Data` typedef for the usual `double` version.
  */
-class Data : public Structure<Data> {
+template<class Scalar = double>
+class DataType : public Structure<DataType<Scalar>> {
 public:
 
+	DataType(void){}
+
+	/**
+	 * Construct from data with a different type of predictions (e.g. to
+	 * get a copy of `Data` with automatic differentiation predictions)
+	 */
+	template<class Other>
+	explicit DataType(const DataType<Other>& other):
+		size_freqs_observed(other.size_freqs_observed),
+		exp_rate_high(other.exp_rate_high){
+		for(uint index=0;index<m_pl_cpue.size();index++) m_pl_cpue[index] = Variable<Lognormal,Scalar>(other.m_pl_cpue[index]);
+		for(uint index=0;index<w_ps_cpue.size();index++) w_ps_cpue[index] = Variable<Lognormal,Scalar>(other.w_ps_cpue[index]);
+		for(uint index=0;index<z_ests.size();index++) z_ests[index] = Variable<Normal,Scalar>(other.z_ests[index]);
+		for(uint index=0;index<size_freqs.size();index++) size_freqs[index] = scalar_value(other.size_freqs[index]);
+	}
+
 	/**
 	 * Maldive pole and line quarterly CPUE
 	 */
-	Array<Variable<Lognormal>,DataYear,Quarter> m_pl_cpue;
+	Array<Variable<Lognormal,Scalar>,DataYear,Quarter> m_pl_cpue;
 
 	/**
 	 * West purse seine annual CPUE
 	 */
-	Array<Variable<Lognormal>,DataYear> w_ps_cpue;
+	Array<Variable<Lognormal,Scalar>,DataYear> w_ps_cpue;
+
+	/**
+	 * West purse seine vulnerable biomass for each quarter of the 
+	 * current year (used to calculate `w_ps_cpue`)
+	 */
+	Array<Scalar,Quarter> w_ps_cpue_quarters;
 
 	/**
 	 * Z-estimates
 	 */
-	Array<Variable<Normal>,DataYear,Quarter,ZSize> z_ests;
+	Array<Variable<Normal,Scalar>,DataYear,Quarter,ZSize> z_ests;
 
 	/**
 	 * Size frequencies
+	 *
+	 * Expected proportions are calculated for all strata (e.g. for use in feasibility checks)
+	 * but only those with observations contribute to the likelihood.
 	 */
-	typedef Variable<FournierRobustifiedMultivariateNormal> SizeFreqVariable;
-	Array<SizeFreqVariable,DataYear,Quarter,Region,Method,Size> size_freqs;
+	Array<Scalar,DataYear,Quarter,Region,Method,Size> size_freqs;
+	std::shared_ptr<const SizeFreqObservations> size_freqs_observed = std::make_shared<SizeFreqObservations>();
 
 	/**
 	 * Count of years in which estimated Z>0.9
@@ -42,11 +290,11 @@ public:
 	/**
 	 * Log-likelihoods for each data sets
 	 */
-	double m_pl_cpue_ll;
-	double w_ps_cpue_ll;
-	double z_ests_ll;
-	double size_freqs_ll;
-	double exp_rate_high_ll;
+	Scalar m_pl_cpue_ll;
+	Scalar w_ps_cpue_ll;
+	Scalar z_ests_ll;
+	Scalar size_freqs_ll;
+	Scalar exp_rate_high_ll;
 
     /**
      * Reflection
@@ -61,10 +309,27 @@ public:
         ;
     }
 
+    /**
+     * Read data from the input bundle if it is up to date (see `Bundle`),
+     * otherwise from the files in `data/input`
+     */
     void read(void){
+    	const Bundle& bundle = Bundle::opened();
+    	auto observed = std::make_shared<SizeFreqObservations>();
+    	if(
+    		bundle.get(Bundle::m_pl_cpue,m_pl_cpue) and
+    		bundle.get(Bundle::w_ps_cpue,w_ps_cpue) and
+    		bundle.get(Bundle::z_ests,z_ests) and
+    		observed->read(bundle)
+    	){
+    		size_freqs_observed = observed;
+    		return;
+    	}
+
     	m_pl_cpue.read("data/input/m_pl_cpue.tsv",true);
     	w_ps_cpue.read("data/input/w_ps_cpue.tsv",true);
-    	size_freqs.read("data/input/size_freqs.tsv",true);
+    	observed->read("data/input/size_freqs.tsv");
+    	size_freqs_observed = observed;
     	z_ests.read("data/input/z_ests.tsv",true);
     }
 
@@ -72,12 +337,30 @@ public:
     	m_pl_cpue.write("data/output/m_pl_cpue.tsv",true);
     	w_ps_cpue.write("data/output/w_ps_cpue.tsv",true);
     	z_ests.write("data/output/z_ests.tsv",true);
-    	size_freqs.write("data/output/size_freqs.tsv",
-    		{"value","proportion","size","sd"},
-    		[](std::ostream& stream, const SizeFreqVariable& var){
-    			stream<<var<<"\t"<<var.proportion<<"\t"<<var.size<<"\t"<<var.sd();
+    	// Written as a dense array with missing observations for unobserved strata
+    	std::ofstream file("data/output/size_freqs.tsv");
+    	file<<"data_year\tquarter\tregion\tmethod\tsize\tvalue\tproportion\tsize\tsd\n";
+    	const auto& observed = *size_freqs_observed;
+    	for(uint year=data_years.begin();year<data_years.end();year++){
+    		for(uint quarter=0;quarter<quarters.size();quarter++){
+    			auto range = observed.range(year,quarter);
+    			for(uint region=0;region<regions.size();region++){
+    				for(uint method=0;method<methods.size();method++){
+    					int stratum = -1;
+    					for(uint index=range.first;index<range.second;index++){
+    						if(observed.strata[index].region==region and observed.strata[index].method==method) stratum = index;
+    					}
+    					for(uint size=0;size<sizes_size;size++){
+    						FournierRobustifiedMultivariateNormal distribution;
+    						if(stratum>=0) distribution = observed.distribution(stratum*sizes_size+size);
+    						file<<year<<"\t"<<quarter<<"\t"<<region<<"\t"<<method<<"\t"<<size<<"\t"
+    							<<size_freqs(year,quarter,region,method,size)<<"\t"
+    							<<distribution.proportion<<"\t"<<distribution.size<<"\t"<<distribution.sd()<<"\n";
+    					}
+    				}
+    			}
     		}
-    	);
+    	}
     }
 
 	/**
@@ -88,9 +371,24 @@ public:
 	 * and are added to data files the model will already be set up to fit that it). 
 	 * There will be a small computational cost to this.
 	 */
-	void get(uint time, const Model& model){
+	void get(uint time, const ModelType<Scalar>& model){
 		uint year = IOSKJ::year(time);
 		uint quarter = IOSKJ::quarter(time);
+
+		// At start, set the bound on the log-likelihood to its maximum
+		if(year==year_min and quarter==0){
+			if(std::isnan(loglike_max_)){
+				loglike_max_ = 0;
+				for(const auto& item : m_pl_cpue) loglike_max_ += term_max_(item);
+				for(const auto& item : w_ps_cpue) loglike_max_ += term_max_(item);
+				for(const auto& item : z_ests) loglike_max_ += term_max_(item);
+				for(auto maximum : size_freqs_observed->maxima) loglike_max_ += maximum;
+			}
+			bound_ = loglike_max_;
+			z_ests_sum_ = 0;
+			size_freqs_sum_ = 0;
+			summed_ = true;
+		}
 		
 		// Maldive PL quarterly CPUE
 		if(year>=2000 and year<=2014){
@@ -99,13 +397,13 @@ public:
 			
 			// At end, scale expected by geometric mean over period 2004-2012
 			if(year==2014 and quarter==3){
-				GeometricMean geomean;
+				ScalarGeometricMean<Scalar> geomean;
 				for(uint year=2004;year<=2012;year++){
 					for(uint quarter=0;quarter<4;quarter++){
 						geomean.append(m_pl_cpue(year,quarter));
 					}
 				}
-				double scaler = 1/geomean.result();
+				Scalar scaler = 1/geomean.result();
 				for(auto& fit : m_pl_cpue) fit *= scaler;
 			}
 		}
@@ -113,46 +411,62 @@ public:
 		// West PS annual CPUE
 		if(year>=1985 and year<=2014){
 			// Currently take a mean of vulnerable biomass over all quarters in the year...
-			static Array<double,Quarter> cpue_quarters;
 			// ... get this quarter's CPUE and save it
-			cpue_quarters(quarter) = model.biomass_vulnerable(WE,PS);
+			w_ps_cpue_quarters(quarter) = model.biomass_vulnerable(WE,PS);
 			// ... if this is the last quarter then take the geometric mean
 			if(quarter==3){
-				w_ps_cpue(year) = geomean(cpue_quarters);
+				w_ps_cpue(year) = ScalarGeometricMean<Scalar>::of(w_ps_cpue_quarters);
 			}	
 
 			// At end, scale expected by geometric mean over period 1991-2010
 			if(year==2014 and quarter==3){
-				GeometricMean geomean;
+				ScalarGeometricMean<Scalar> geomean;
 				for(uint year=1991;year<=2010;year++){
 					geomean.append(w_ps_cpue(year,quarter));
 				}
-				double scaler = 1/geomean.result();
+				Scalar scaler = 1/geomean.result();
 				for(auto& fit : w_ps_cpue) fit *= scaler;
 			}	
 		}
 
+		// Numbers by region and size (the product of the numbers by region and age and the
+		// age-size distribution matrices) used for both size frequencies and Z-estimates
+		Array<Scalar,Region,Size> numbers_size = Scalar(0);
+		if(year>=1982 and year<=2014){
+			for(auto region : regions){
+				for(auto age : ages){
+					Scalar number = model.numbers(region,age);
+					for(auto size : sizes) numbers_size(region,size) += number * model.age_size(age,size);
+				}
+			}
+		}
+
 		// Size frequencies by region and method
 		if(year>=1982 and year<=2014){
 			// Generate expected size frequencies for each method in each 
 			// region regardless of whether there is observed data or not
 			for(auto region : regions){
 				for(auto method : methods){
-					Array<double,Size> composition = 0;
-					// Calculate selected numbers by size accumulated over ages
-					for(auto size : sizes){
-						for(auto age : ages){
-							composition(size) += model.numbers(region,age) * 
-												 model.age_size(age,size) *
-												 model.selectivity_size(method,size);
-						}
-					}
-					// Proportionalise
-					composition /= sum(composition);
-					// Store
-					for(auto size : sizes) size_freqs(year,quarter,region,method,size) = composition(size);
+					// Calculate selected numbers by size
+					Array<Scalar,Size> composition;
+					for(auto size : sizes) composition(size) = numbers_size(region,size) * model.selectivity_size(method,size);
+					// Proportionalise and store
+					Scalar total = 0;
+					for(auto size : sizes) total += composition(size);
+					for(auto size : sizes) size_freqs(year,quarter,region,method,size) = composition(size)/total;
 				}
 			}
+			// Calculate log-likelihoods for observed strata
+			const auto& observed = *size_freqs_observed;
+			auto range = observed.range(year,quarter);
+			for(uint stratum=range.first;stratum<range.second;stratum++){
+				const auto& at = observed.strata[stratum];
+				Scalar expected[sizes_size];
+				for(auto size : sizes) expected[size.index()] = size_freqs(year,quarter,at.region,at.method,size);
+				Scalar term = observed.loglike(stratum,expected);
+				size_freqs_sum_ += term;
+				bound_ += scalar_value(term) - observed.maxima[stratum];
+			}
 		}
 
 		// Size based Z-estimates for WE region from tagging
@@ -160,29 +474,23 @@ public:
 			// Generate expected values of Z for each size bin
 			// Expected values of Z are calculated by combining natural mortality and 
 			// fishing mortality rates
+			// Calculate the expected number of survivors by age
+			Array<Scalar,Age> survivors;
+			for(auto age : ages) survivors(age) = model.survival(age) * model.escapement(WE,age) * model.numbers(WE,age);
 			for(auto z_size : z_sizes){
 				// Model size classes are 2mm wide, so for each of the 5mm wide Z-estimate bins there are three model
 				// size classes to average over e.g. 
 				//   45-50 Z-estimate size bin ~ 45,47,49 model size class mid points ~ ([44,46,48])/2 ~ 22,23,24 size dimension levels
 				// Calculate the mean Z for the model size classes in each Z-estimate size bin
-				double z = 0;
+				Scalar z = 0;
 				uint z_lower = 45+z_size.index()*5;
 				uint size_class = (z_lower-1)/2;
 				for(uint size=size_class;size<size_class+3;size++){
 					// Calculate a weighted overall survival across age classes for the size
-					double numerator = 0;
-					double denominator = 0;
-					for(auto age : ages){
-						// Expected number in this size bin
-						double number = model.numbers(WE,age) * model.age_size(age,size);
-						// Survival for this age
-						double survival = model.survival(age) * model.escapement(WE,age);
-						// Add to average
-						numerator += survival*number;
-						denominator += number;
-					}
-					// Calculate weighted mean
-					double survival = numerator/denominator;
+					// (the ratio of the expected number of survivors to the expected number in this size bin)
+					Scalar numerator = 0;
+					for(auto age : ages) numerator += survivors(age) * model.age_size(age,size);
+					Scalar survival = numerator/numbers_size(WE,size);
 					// Capture cases where survuval is estimated to be zero to prevent overflow
 					if(survival>0) z += -log(survival);
 					else z += -log(0.000001);
@@ -190,6 +498,7 @@ public:
 				z /= 3;
 				// Store
 				z_ests(year,quarter,z_size) = z;
+				sum_(z_ests(year,quarter,z_size),z_ests_sum_);
 			}
 		}
 
@@ -200,19 +509,43 @@ public:
 		}
 	}
 
-	double loglike(void){
+	/**
+	 * Get an upper bound on the log-likelihood given the predictions made so far
+	 *
+	 * Terms for predictions which have not yet been made (including the CPUE predictions,
+	 * which are only final once they are scaled at the end of the series) are at their maximum.
+	 * Used to stop a hindcast as soon as it is certain that its likelihood will be too
+	 * low (see `Likelihoods` in `ioskj.cpp`).
+	 */
+	double loglike_bound(void) const {
+		return bound_ - exp_rate_high;
+	}
+
+	Scalar loglike(void){
 		m_pl_cpue_ll = 0;
 		for(auto& item : m_pl_cpue) m_pl_cpue_ll += item.loglike();
 
 		w_ps_cpue_ll = 0;
 		for(auto& item : w_ps_cpue) w_ps_cpue_ll += item.loglike();
 
-		z_ests_ll = 0;
-		for(auto& item : z_ests) z_ests_ll += item.loglike();
+		// Z-estimate and size frequency terms are summed by `get()` as predictions are made
+		// (in the same order as here so the sums are identical)
+		if(summed_){
+			z_ests_ll = z_ests_sum_;
+			size_freqs_ll = size_freqs_sum_;
+		} else {
+			z_ests_ll = 0;
+			for(auto& item : z_ests) z_ests_ll += item.loglike();
 
-		FournierRobustifiedMultivariateNormal::max_size = 30;
-		size_freqs_ll = 0;
-		for(auto& item : size_freqs) size_freqs_ll += item.loglike();
+			size_freqs_ll = 0;
+			const auto& observed = *size_freqs_observed;
+			for(uint stratum=0;stratum<observed.strata.size();stratum++){
+				const auto& at = observed.strata[stratum];
+				Scalar expected[sizes_size];
+				for(auto size : sizes) expected[size.index()] = size_freqs(at.year,at.quarter,at.region,at.method,size);
+				size_freqs_ll += observed.loglike(stratum,expected);
+			}
+		}
 
 		exp_rate_high_ll = -exp_rate_high;
 
@@ -226,6 +559,45 @@ public:
     	;
     }
 
-}; // class Data
+private:
+
+	/**
+	 * Sum of the maximum of each log-likelihood term and the
+	 * current upper bound on the log-likelihood (see `loglike_bound()`)
+	 */
+	double loglike_max_ = NAN;
+	double bound_ = 0;
+
+	/**
+	 * Sums of log-likelihood terms for predictions made by `get()` (only
+	 * used by `loglike()` if `get()` has been called from the start)
+	 */
+	bool summed_ = false;
+	Scalar z_ests_sum_ = 0;
+	Scalar size_freqs_sum_ = 0;
+
+	/**
+	 * Maximum of a log-likelihood term (zero if there is no observation or
+	 * the prediction is missing)
+	 */
+	template<class Item>
+	static double term_max_(const Item& item){
+		return item.valid()?std::max(item.loglike_max(),0.0):0;
+	}
+
+	/**
+	 * Add the log-likelihood term for a prediction to a sum and 
+	 * replace its maximum in the bound
+	 */
+	template<class Item>
+	void sum_(const Item& item, Scalar& sum){
+		Scalar term = item.loglike();
+		sum += term;
+		bound_ += scalar_value(term) - term_max_(item);
+	}
+
+}; // class DataType
+
+typedef DataType<> Data;
 
 } // namespace IOSKJ
@@ -25,7 +25,8 @@ public:
 	static const char* name(void) { return "year"; }
 } years;
 
-STENCILA_DIM(Quarter,quarters,quarter,4);
+const uint quarters_size = 4;
+STENCILA_DIM(Quarter,quarters,quarter,quarters_size);
 
 /**
  * @name DataYear
@@ -50,20 +51,24 @@ public:
  */
 STENCILA_DIM_RANGE(RecdevYear,recdev_years,recdev_year,1985,2012);
 
-STENCILA_DIM(Region,regions,region,3);
-STENCILA_DIM(RegionFrom,region_froms,region_from,3);
+const uint regions_size = 3;
+STENCILA_DIM(Region,regions,region,regions_size);
+STENCILA_DIM(RegionFrom,region_froms,region_from,regions_size);
 enum {
 	WE = 0,
 	MA = 1,
 	EA = 2
 };
 
-STENCILA_DIM(Age,ages,age,24);
+const uint ages_size = 24;
+STENCILA_DIM(Age,ages,age,ages_size);
 
-STENCILA_DIM(Size,sizes,size,40);
+const uint sizes_size = 40;
+STENCILA_DIM(Size,sizes,size,sizes_size);
 STENCILA_DIM(SizeFrom,size_froms,size_from,40);
 
-STENCILA_DIM(Method,methods,method,4);
+const uint methods_size = 4;
+STENCILA_DIM(Method,methods,method,methods_size);
 enum {
 	PS = 0,
 	PL = 1,
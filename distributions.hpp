@@ -3,13 +3,167 @@
 namespace Utilities {
 namespace Distributions {
 
+/**
+ * Counter-based random number generator (Philox4x32-10; Salmon et al. 2011 
+ * "Parallel random numbers: as easy as 1, 2, 3")
+ *
+ * Each block of four 32-bit random numbers is a pure function of a key and a counter.
+ * The key is made up of the seed and a replicate number and the counter is made up of a 
+ * procedure number, a time, a purpose and a block number. That means that any stream 
+ * can be addressed directly (see `stream()`) and that skipping ahead (see `discard()`) 
+ * takes constant time, without replaying draws.
+ *
+ * Satisfies the requirements of a uniform random number generator so can
+ * be used with `boost::variate_generator` and Boost.Random distributions.
+ */
+class Philox {
+public:
+
+	typedef uint32_t result_type;
+
+	static constexpr result_type min(void) {
+		return 0;
+	}
+
+	static constexpr result_type max(void) {
+		return 0xFFFFFFFF;
+	}
+
+	Philox(uint32_t seed = 0){
+		this->seed(seed);
+	}
+
+	/**
+	 * Seed the generator. Resets to the start of the first stream.
+	 */
+	void seed(uint32_t seed){
+		key_[0] = seed;
+		key_[1] = 0;
+		counter_[0] = 0;
+		counter_[1] = 0;
+		counter_[2] = 0;
+		position_ = 0;
+		cached_ = false;
+	}
+
+	/**
+	 * Get the seed
+	 */
+	uint32_t seed_get(void) const {
+		return key_[0];
+	}
+
+	/**
+	 * Get a generator for the stream at a particular address
+	 */
+	Philox stream(uint32_t replicate, uint32_t procedure, uint32_t time, uint32_t purpose) const {
+		Philox stream(key_[0]);
+		stream.key_[1] = replicate;
+		stream.counter_[0] = procedure;
+		stream.counter_[1] = time;
+		stream.counter_[2] = purpose;
+		return stream;
+	}
+
+	/**
+	 * Skip ahead `count` random numbers
+	 */
+	void discard(unsigned long long count){
+		position_ += count;
+	}
+
+	result_type operator()(void){
+		uint32_t block = position_ >> 2;
+		if(not cached_ or block!=counter_[3]){
+			counter_[3] = block;
+			generate_();
+		}
+		return block_[position_++ & 3];
+	}
+
+private:
+
+	uint32_t key_[2];
+	uint32_t counter_[4];
+	uint32_t block_[4];
+	uint64_t position_;
+	bool cached_;
+
+	void generate_(void){
+		const uint32_t m0 = 0xD2511F53;
+		const uint32_t m1 = 0xCD9E8D57;
+		const uint32_t w0 = 0x9E3779B9;
+		const uint32_t w1 = 0xBB67AE85;
+		uint32_t k0 = key_[0];
+		uint32_t k1 = key_[1];
+		uint32_t c0 = counter_[0];
+		uint32_t c1 = counter_[1];
+		uint32_t c2 = counter_[2];
+		uint32_t c3 = counter_[3];
+		for(int round=0;round<10;round++){
+			uint64_t p0 = uint64_t(m0) * c0;
+			uint64_t p1 = uint64_t(m1) * c2;
+			c0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+			c1 = uint32_t(p1);
+			c2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+			c3 = uint32_t(p0);
+			k0 += w0;
+			k1 += w1;
+		}
+		block_[0] = c0;
+		block_[1] = c1;
+		block_[2] = c2;
+		block_[3] = c3;
+		cached_ = true;
+	}
+};
+
+/**
+ * Purposes of random draws used in addressing streams
+ */
+enum Purpose {
+	purpose_recruitment = 1,
+	purpose_imprecision = 2,
+	purpose_implementation = 3,
+	purpose_demc = 4,
+	purpose_dreamzs = 5
+};
+
 /**
  * Random number generator
+ *
+ * Thread local so that each worker thread (e.g. in `evaluate()`) 
+ * has its own state. Draws made using `random()` methods of distributions
+ * come sequentially from this generator. Draws which need to be reproducible
+ * for a particular replicate, procedure and time (e.g. recruitment deviations)
+ * are made from a `stream()`. The replicate and procedure are always passed
+ * explicitly (e.g. to `Model::update()`) by the task doing the simulation.
+ *
+ * This is how tasks which use worker threads (see `threads`) give the same results regardless of the
+ * number of threads: every worker is seeded with the same seed, any draw which depends on the item of work
+ * (e.g. a replicate, trial or chain in a generation) comes from a stream addressed by that item rather than
+ * sequentially, and results are combined in item order rather than in the order in which they finish.
  */
-struct Generator : boost::mt19937 {
+thread_local struct Generator : Philox {
+
 	Generator(void){
 		seed(static_cast<unsigned int>(std::time(0)));
 	}
+
+	/**
+	 * Get a stream for a replicate and procedure
+	 *
+	 * Recruitment variation is common to all procedures so that they are
+	 * evaluated using common random numbers.
+	 */
+	Philox stream(uint32_t replicate, uint32_t procedure, uint32_t time, Purpose purpose) const {
+		return Philox::stream(
+			replicate,
+			(purpose==purpose_recruitment)?0:(procedure+1),
+			time,
+			purpose
+		);
+	}
 } Generator;
 
 /**
@@ -94,8 +248,13 @@ public:
 	}
 
     double random(void) const {
+        return derived().random(Generator);
+    }
+
+    template<class Engine>
+    double random(Engine& engine) const {
         auto boost_rand = derived().boost_rand();
-        boost::variate_generator<boost::mt19937&,decltype(boost_rand)> random(Generator,boost_rand);
+        boost::variate_generator<Engine&,decltype(boost_rand)> random(engine,boost_rand);
         return random();
     }
 };
@@ -205,6 +364,21 @@ public:
         return boost::random::normal_distribution<>(mean,sd);
     }
 
+    using Distribution<Normal>::loglike;
+
+    template<class Scalar>
+    Scalar loglike(const Scalar& x) const {
+        Scalar z = (x-mean)/sd;
+        return -0.5*z*z - std::log(sd*std::sqrt(2*M_PI));
+    }
+
+    /**
+     * Maximum log-likelihood (at the mode)
+     */
+    double loglike_max(void) const {
+        return -std::log(sd*std::sqrt(2*M_PI));
+    }
+
     template<class Mirror>
     void reflect(Mirror& mirror) {
         mirror
@@ -233,9 +407,12 @@ public:
         return max;
     }
 
-    double random(void) const {
+    using Distribution<TruncatedNormal>::random;
+
+    template<class Engine>
+    double random(Engine& engine) const {
         boost::random::normal_distribution<> dist(mean,sd);
-        boost::variate_generator<boost::mt19937&,decltype(dist)> random(Generator,dist);
+        boost::variate_generator<Engine&,decltype(dist)> random(engine,dist);
         auto trial = random();
         if(trial<min or trial>max) trial = random();
         return trial;
@@ -247,6 +424,15 @@ public:
         else return boost::math::pdf(norm,x);
     }
 
+    using Distribution<TruncatedNormal>::loglike;
+
+    template<class Scalar>
+    Scalar loglike(const Scalar& x) const {
+        if(x<min or x>max) return std::log(std::numeric_limits<double>::epsilon());
+        Scalar z = (x-mean)/sd;
+        return -0.5*z*z - std::log(sd*std::sqrt(2*M_PI));
+    }
+
     template<class Mirror>
     void reflect(Mirror& mirror) {
         mirror
@@ -286,6 +472,23 @@ public:
         // older version is used for now.
         return boost::lognormal_distribution<>(location,dispersion);
     }
+
+    using Distribution<Lognormal>::loglike;
+
+    template<class Scalar>
+    Scalar loglike(const Scalar& x) const {
+        using std::log;
+        if(x<=0) return -INFINITY;
+        Scalar z = (log(x)-location)/dispersion;
+        return -0.5*z*z - log(x*dispersion*std::sqrt(2*M_PI));
+    }
+
+    /**
+     * Maximum log-likelihood (at the mode, `exp(location-dispersion^2)`)
+     */
+    double loglike_max(void) const {
+        return -location + 0.5*dispersion*dispersion - std::log(dispersion*std::sqrt(2*M_PI));
+    }
     
     template<class Mirror>
     void reflect(Mirror& mirror) {
@@ -324,13 +527,24 @@ public:
         return boost::math::uniform(lower,upper);
     }
 
-    double random(void) const {
+    using Distribution<Uniform>::loglike;
+
+    template<class Scalar>
+    Scalar loglike(const Scalar& x) const {
+        if(x<lower or x>upper) return -INFINITY;
+        return -std::log(upper-lower);
+    }
+
+    using Distribution<Uniform>::random;
+
+    template<class Engine>
+    double random(Engine& engine) const {
         // If lower and upper are equal then boost random number generator
         // will loop endlessly attempting to create a valid value. So escape that condition...
         if(lower==upper) return lower;
         else{
             boost::uniform_real<> distr(lower,upper);
-            boost::variate_generator<boost::mt19937&,decltype(distr)> randomVariate(Generator,distr);
+            boost::variate_generator<Engine&,decltype(distr)> randomVariate(engine,distr);
             return randomVariate();
         }
     }
@@ -350,11 +564,13 @@ public:
 
     double proportion;
     double size;
-    static double max_size;
+    // Maximum effective sample size
+    double max_size;
 
-    FournierRobustifiedMultivariateNormal(const double& proportion = NAN, const double& size = NAN):
+    FournierRobustifiedMultivariateNormal(const double& proportion = NAN, const double& size = NAN, const double& max_size = 1000):
         proportion(proportion),
-        size(size){
+        size(size),
+        max_size(max_size){
     }
 
     bool valid(void) const {
@@ -377,10 +593,46 @@ public:
         return proportion * (1-proportion);
     }
 
-    double loglike(const double& x) const {
+    template<class Scalar>
+    Scalar loglike(const Scalar& x) const {
+        using std::exp;
+        using std::log;
+        using std::pow;
         double n_apos = std::min(size,max_size);
-        double e_apos = (1-x)*x+0.1/40.0;
-        return 0.5*e_apos+std::log(std::exp(-std::pow(proportion-x,2)/(2*e_apos/n_apos))+0.01);
+        Scalar e_apos = (1-x)*x+0.1/40.0;
+        return 0.5*e_apos+log(exp(-pow(proportion-x,2)/(2*e_apos/n_apos))+0.01);
+    }
+
+    /**
+     * Log-likelihood of a block of expected proportions (e.g. a size composition)
+     * given contiguous arrays of observed proportions and sample sizes
+     *
+     * Terms which are not valid, or for which the expected proportion is missing, are zero (as for `Variable::loglike()`).
+     * The loop body is free of branches and calls other than `exp` and `log` so that it can be
+     * vectorised by the compiler. Terms are the same as those of `loglike(x)`.
+     */
+    static double loglike(unsigned int count, const double* proportions, const double* sizes, const double* expected, double max_size){
+        double sum = 0;
+        for(unsigned int index=0;index<count;index++){
+            double proportion = proportions[index];
+            double size = sizes[index];
+            double x = expected[index];
+            bool valid = std::isfinite(proportion) & (size>0) & (not std::isnan(x));
+            double n_apos = size<max_size?size:max_size;
+            double e_apos = (1-x)*x+0.1/40.0;
+            double diff = proportion-x;
+            double term = 0.5*e_apos+std::log(std::exp(-(diff*diff)/(2*e_apos/n_apos))+0.01);
+            sum += valid?term:0;
+        }
+        return sum;
+    }
+
+    /**
+     * Upper bound on the log-likelihood (for proportions between zero and one,
+     * `e_apos` is at most 0.25+0.1/40 and the exponential term is at most one)
+     */
+    double loglike_max(void) const {
+        return 0.5*(0.25+0.1/40.0)+std::log(1.01);
     }
 
     template<class Mirror>
@@ -391,8 +643,34 @@ public:
         ;
     }
 };
-double FournierRobustifiedMultivariateNormal::max_size = 1000;
 
 
+/**
+ * Get the value of a scalar as a `double`
+ *
+ * Automatic differentiation types used to instantiate templated classes (e.g. `ModelType`)
+ * should provide an overload of this function in their own namespace.
+ */
+inline double scalar_value(double x){
+    return x;
+}
+
+/**
+ * Normal cumulative distribution function
+ *
+ * For doubles this uses `Normal::cdf()`. The generic version, for automatic 
+ * differentiation types, uses the complementary error function.
+ */
+inline double normal_cdf(double x, double mean, double sd){
+    return Normal(mean,sd).cdf(x);
+}
+
+template<class Scalar>
+Scalar normal_cdf(double x, const Scalar& mean, const Scalar& sd){
+    using std::erfc;
+    using std::sqrt;
+    return 0.5*erfc(-(x-mean)/(sd*sqrt(2.0)));
+}
+
 } // namespace Distributions
 } // namespace IOSKJ
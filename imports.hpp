@@ -6,13 +6,32 @@
 
 // C++ standard library
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <csignal>
+#include <chrono>
 #include <fstream>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+#include <map>
+#include <functional>
+#include <type_traits>
+//... threads for parallel tasks
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 
 // Boost library (http://www.boost.org/) for...
 //... file system utilities
 #include <boost/filesystem.hpp>
+//... memory mapped files
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 //... random number scaffolding...
-#include <boost/random/mersenne_twister.hpp>
 #include <boost/random/variate_generator.hpp>
 //... distributions
 #include <boost/math/distributions/uniform.hpp>
@@ -8,12 +8,50 @@
 #include "procedures.hpp"
 #include "performance.hpp"
 #include "tracker.hpp"
+#include "batch.hpp"
+#include "references.hpp"
+#include "snapshots.hpp"
+#include "bundle.hpp"
+#include "laplace.hpp"
 
 using namespace IOSKJ;
 
+/**
+ * Number of worker threads used by tasks which can be run in parallel
+ * (currently `evaluate` and the `condition_*` tasks). Set using the `--threads` command line option.
+ */
+uint threads = 1;
+
+/**
+ * Number of models updated together in a `ModelBatch`
+ */
+const uint lanes = 8;
+
+/**
+ * Should reference points be persisted between runs of `evaluate`
+ * in "evaluate/output/references_cache.tsv"? Set using the `--references-cache` 
+ * command line option.
+ */
+bool references_persist = false;
+
+/**
+ * Should `condition_demc` resume from its last checkpoint? Set using
+ * the `--resume` command line option.
+ */
+bool resume = false;
+
+/**
+ * Set when a SIGTERM or SIGINT is received so that long running tasks (currently `condition_demc`)
+ * can save their state and exit
+ */
+volatile std::sig_atomic_t interrupted = 0;
+
 /**
  * Run the model with a parameters set read from "parameters/input"
  *
+ * Random numbers (e.g. for recruitment variation and for the procedure) come from the
+ * streams of replicate `samples_row` (see `Generator`).
+ *
  * @param samples_file A filesystem path to a TSV file of parameter samples
  * @parameters samples_row Row index of samples to select
  */
@@ -31,10 +69,8 @@ void run(const std::string& samples_file="ref",int samples_row=0,int procedure=0
 		// Read in samples
 		Frame samples;
 		samples.read(samples_file);
-		//... select desired row
-		Frame row = samples.slice(samples_row);
-		//... overwrite parameters available, ignoring catches
-		parameters.read(row,{"catches"});
+		//... overwrite parameters available with the desired row
+		parameters.read(Parameters::Rows(samples),samples_row);
 	}
 	// Read in data
 	Data data;
@@ -52,10 +88,13 @@ void run(const std::string& samples_file="ref",int samples_row=0,int procedure=0
 		//... set model parameters
 		parameters.set(time,model);
 		//... update the model
-		model.update(time);
+		model.update(time,samples_row);
 		//... operate the procedure
 		if(time>time_calc(2014,3)){
-			if(time==time_calc(2014,3)+1) procedures.reset(procedure,time,model);
+			if(time==time_calc(2014,3)+1){
+				procedures[procedure]->streams(samples_row,procedure);
+				procedures.reset(procedure,time,model);
+			}
 			procedures.operate(procedure,time,model);
 		}
 		//... get model variables corresponding to data
@@ -69,34 +108,52 @@ void run(const std::string& samples_file="ref",int samples_row=0,int procedure=0
 	data.write();
 }
 
+/**
+ * Track the hindcast for each row of a parameter samples file
+ *
+ * Each row uses the random number streams of the replicate with the same number (see `Generator`)
+ * so that rows have independent recruitment variation.
+ *
+ * @param samples_file A filesystem path to a TSV file of parameter samples
+ */
 void tracks(const std::string& samples_file){
 	// Read in parameters
 	Parameters parameters;
 	parameters.read();
-	// Read in data
-	Data data;
-	data.read();
 	// Read in samples
-	Frame samples;
-	samples.read(samples_file);
+	Frame samples_frame;
+	samples_frame.read(samples_file);
+	Parameters::Rows samples(samples_frame);
 	// Do tracking
 	Tracker tracker("model/output/track.tsv");
-	for(uint row=0;row<samples.rows();row++){
-		//Overwrite parameters available, but don't worry about catches
-		parameters.read(samples.slice(row),{"catches"});
-		// Instantiate a model
-		Model model;
+	// Simulate batches of samples together
+	std::unique_ptr<ModelBatch<lanes>> batch(new ModelBatch<lanes>());
+	for(uint first=0;first<samples.rows();first+=lanes){
+		uint count = std::min(lanes,uint(samples.rows()-first));
+		std::vector<Parameters> parameters_lanes(count,parameters);
+		std::vector<Model> models(count);
+		std::ostringstream tracks[lanes];
+		for(uint lane=0;lane<count;lane++){
+			//Overwrite parameters available
+			parameters_lanes[lane].read(samples,first+lane);
+		}
 		// For each time step...
 		for(uint time=0;time<=time_calc(2014,3);time++){
 			//... set model parameters
-			parameters.set(time,model);
-			//... update the model
-			model.update(time);
-			//... get model variables corresponding to data
-			data.get(time,model);
+			for(uint lane=0;lane<count;lane++){
+				parameters_lanes[lane].set(time,models[lane]);
+				if(time==0) batch->load(lane,models[lane],first+lane);
+				else batch->inputs(lane,models[lane]);
+			}
+			//... update the models
+			batch->update(time);
 			//... get model variables of interest for tracking
-			tracker.get(row,0,time,model);
+			for(uint lane=0;lane<count;lane++){
+				batch->store(lane,models[lane]);
+				Tracker::get(tracks[lane],first+lane,0,time,models[lane]);
+			}
 		}
+		for(uint lane=0;lane<count;lane++) tracker.file<<tracks[lane].str();
 	}
 }
 
@@ -117,11 +174,11 @@ void yield(void){
 	model.msy_go();
 	Frame msy(
 		{
-			"e_msy","f_msy","msy","biomass_spawners_msy","biomass_spawners_unfished","msy_trials",
+			"e_msy","f_msy","msy","biomass_spawners_msy","biomass_spawners_unfished","msy_trials","equilibrium_steps",
 			"msy_total","msy_we_ps","msy_ma_pl","msy_ea_gn"
 		},
 		{
-			model.e_msy,model.f_msy,model.msy,model.biomass_spawners_msy,sum(model.biomass_spawners_unfished),double(model.msy_trials),
+			model.e_msy,model.f_msy,model.msy,model.biomass_spawners_msy,sum(model.biomass_spawners_unfished),double(model.msy_trials),double(model.equilibrium_steps),
 			model.catches_taken(sum),model.catches_taken(WE,PS),model.catches_taken(MA,PL),model.catches_taken(EA,GN)
 		}
 	);
@@ -147,47 +204,186 @@ void priors(int replicates=1000){
 }
 
 /**
- * Check feasibility constraints for a model
+ * Check feasibility constraints for a batch of trials
+ *
+ * The models for up to `lanes` trials are updated together. Each trial uses its own copy of `data`
+ * so batches can be checked on separate threads. Recruitment variation for a trial comes from the
+ * random number streams of the replicate with the trial's number (see `Generator`).
+ *
+ * @param trial Trial number of the first parameter set
+ * @param parameters Parameter sets for each trial
  */
 typedef int (Check)(const Model& model, const Data& data, uint time, uint year, uint quarter);
-void check(Check check, int trial, Parameters& parameters, Data& data, Tracker& tracker, Frame& accepted, Frame& rejected){
-	Model model;
+struct Checked {
+	// Parameters and associated likelihoods for each trial
+	std::vector<Frame> outcomes;
+	// Was each trial rejected?
+	std::vector<bool> rejects;
+	// Tracking output for the batch
+	std::string track;
+};
+Checked check(Check check, int trial, std::vector<Parameters>& parameters, const Data& data){
+	uint count = parameters.size();
+	std::unique_ptr<ModelBatch<lanes>> batch(new ModelBatch<lanes>());
+	std::vector<Model> models(count);
+	// Each trial needs its own data since model predictions are stored there
+	std::vector<Data> datas(count,data);
+	std::ostringstream tracks[lanes];
+	Checked checked;
+	checked.outcomes.resize(count);
+	checked.rejects.resize(count,false);
+	uint remaining = count;
 	uint time = 0;
 	uint time_end = time_calc(2014,3);
-	for(;time<=time_end;time++){
+	for(;time<=time_end and remaining>0;time++){
 		// Do the time step
 		//... set parameters
-		parameters.set(time,model);
-		//... update the model
-		model.update(time);
-		//... get data
-		data.get(time,model);
-		//... do tracking
-		if(trial<100) tracker.get(trial,-1,time,model);
-		//... check model
+		for(uint lane=0;lane<count;lane++){
+			parameters[lane].set(time,models[lane]);
+			if(time==0) batch->load(lane,models[lane],trial+lane);
+			else batch->inputs(lane,models[lane]);
+		}
+		//... update the models
+		batch->update(time);
 		uint year = IOSKJ::year(time);
 		uint quarter = IOSKJ::quarter(time);
-		int criterion = check(model,data,time,year,quarter);
-		if(criterion!=0 or time==time_end){
-			//... get parameters and associated likelihoods
-			Frame values = parameters.values();
-			values.add("pars_like",parameters.loglike());
-			values.add("data_like",data.loglike());
-			if(criterion!=0){
-				values.add("trial",trial);
-				values.add("time",time);
-				values.add("year",year);
-				values.add("quarter",quarter);
-				values.add("criterion",criterion);
-				rejected.append(values);
-				break;
-			}
-			if(time==time_end){
-				accepted.append(values);
-			}
-		}
-	}
-	if(trial>0 and trial%10==0) std::cout<<trial<<" "<<accepted.rows()/float(trial)<<std::endl;
+		for(uint lane=0;lane<count;lane++){
+			// Skip trials which have already finished
+			if(checked.outcomes[lane].rows()>0) continue;
+			Model& model = models[lane];
+			Data& data = datas[lane];
+			batch->store(lane,model);
+			//... get data
+			data.get(time,model);
+			//... do tracking
+			if(trial+lane<100) Tracker::get(tracks[lane],trial+lane,-1,time,model);
+			//... check model
+			int criterion = check(model,data,time,year,quarter);
+			if(criterion!=0 or time==time_end){
+				//... get parameters and associated likelihoods
+				Frame values = parameters[lane].values();
+				values.add("pars_like",parameters[lane].loglike());
+				values.add("data_like",data.loglike());
+				if(criterion!=0){
+					values.add("trial",trial+lane);
+					values.add("time",time);
+					values.add("year",year);
+					values.add("quarter",quarter);
+					values.add("criterion",criterion);
+					checked.rejects[lane] = true;
+				}
+				checked.outcomes[lane] = values;
+				remaining--;
+			}
+		}
+	}
+	for(uint lane=0;lane<count;lane++) checked.track += tracks[lane].str();
+	return checked;
+}
+
+/**
+ * Check feasibility constraints for a number of trials
+ *
+ * Trials are checked in batches (see `check()` above) and, if `threads` is greater than one,
+ * batches are handed out to a pool of worker threads. Parameter sets are drawn, using `sample`, on the calling
+ * thread in trial order and outputs are appended to `accepted`, `rejected` and `tracker` in trial order
+ * (see `Generator`).
+ *
+ * @param trials Number of trials
+ * @param sample Function which returns the parameter set for the next trial
+ */
+void check(Check check, int trials, std::function<Parameters(void)> sample, const Data& data, Tracker& tracker, Frame& accepted, Frame& rejected){
+	// Draw the parameter sets for a batch
+	auto draw = [&](int trial){
+		std::vector<Parameters> parameters;
+		for(int lane=trial;lane<std::min(trial+int(lanes),trials);lane++) parameters.push_back(sample());
+		return parameters;
+	};
+	// Append the outputs of a batch
+	auto append = [&](int trial, Checked& checked){
+		tracker.file<<checked.track;
+		for(uint lane=0;lane<checked.outcomes.size();lane++){
+			if(checked.rejects[lane]) rejected.append(checked.outcomes[lane]);
+			else accepted.append(checked.outcomes[lane]);
+			int trial_lane = trial+lane;
+			if(trial_lane>0 and trial_lane%10==0) std::cout<<trial_lane<<" "<<accepted.rows()/float(trial_lane)<<std::endl;
+		}
+	};
+
+	if(threads<=1){
+		for(int trial=0;trial<trials;trial+=lanes){
+			std::vector<Parameters> parameters = draw(trial);
+			Checked checked = ::check(check,trial,parameters,data);
+			append(trial,checked);
+		}
+		return;
+	}
+
+	// Batches which have been drawn but not yet appended. To limit memory use, at most
+	// two batches per thread are held at any one time.
+	struct Batch {
+		std::vector<Parameters> parameters;
+		Checked checked;
+		std::exception_ptr error;
+		bool done = false;
+	};
+	std::map<int,Batch> batches;
+	int drawn = 0;
+	int taken = 0;
+	bool stop = false;
+	std::mutex mutex;
+	std::condition_variable changed;
+	// Start worker threads
+	uint32_t seed = Generator.seed_get();
+	std::vector<std::thread> workers;
+	for(uint thread=0;thread<threads;thread++){
+		workers.emplace_back([&](){
+			// Use the same random number streams as the calling thread
+			Generator.seed(seed);
+			while(true){
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock,[&](){ return stop or taken<drawn; });
+				if(stop) return;
+				int trial = taken++ * lanes;
+				Batch& batch = batches[trial];
+				lock.unlock();
+				try {
+					batch.checked = ::check(check,trial,batch.parameters,data);
+				} catch(...) {
+					batch.error = std::current_exception();
+				}
+				lock.lock();
+				batch.done = true;
+				changed.notify_all();
+			}
+		});
+	}
+	// Draw batches and append their outputs (in order)
+	std::exception_ptr error;
+	for(int trial=0;trial<trials;trial+=lanes){
+		std::unique_lock<std::mutex> lock(mutex);
+		while(drawn*int(lanes)<trials and drawn*int(lanes)<trial+int(2*threads*lanes)){
+			batches[drawn*lanes].parameters = draw(drawn*lanes);
+			drawn++;
+		}
+		changed.notify_all();
+		changed.wait(lock,[&](){ return batches[trial].done; });
+		Batch batch = std::move(batches[trial]);
+		batches.erase(trial);
+		lock.unlock();
+		if(batch.error){
+			error = batch.error;
+			break;
+		}
+		append(trial,batch.checked);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+		changed.notify_all();
+	}
+	for(auto& worker : workers) worker.join();
+	if(error) std::rethrow_exception(error);
 }
 
 
@@ -220,16 +416,13 @@ int check_feasible(const Model& model, const Data& data, uint time, uint year, u
 	) return 3;
 
 	// MA PL CPUE ...
-	static double m_pl_cpue_base;
-	if(year==2004 and quarter==2) m_pl_cpue_base = data.m_pl_cpue(year,quarter);
-	// ... must have decreased from 2004 to 2011
-	if(year==2011 and quarter==2 and data.m_pl_cpue(year,quarter)/m_pl_cpue_base>1) return 4;
+	// ... must have decreased from 2004 to 2011 (CPUE predictions
+	// are not rescaled until the end of 2014 so can be compared directly)
+	if(year==2011 and quarter==2 and data.m_pl_cpue(year,quarter)/data.m_pl_cpue(2004,2)>1) return 4;
 
 	// W PS CPUE ...
-	static double w_ps_cpue_base;
-	if(year==2000 and quarter==3) w_ps_cpue_base = data.w_ps_cpue(year);
-	// ... must have decreased from 2004 to 2011
-	if(year==2011 and quarter==3 and data.w_ps_cpue(year)/w_ps_cpue_base>1) return 5;
+	// ... must have decreased from 2000 to 2011
+	if(year==2011 and quarter==3 and data.w_ps_cpue(year)/data.w_ps_cpue(2000)>1) return 5;
 
 	// Z-estimates
 	if(year>=2006 and year<=2009){
@@ -310,13 +503,12 @@ void condition_feasible(int trials=100){
 	Frame rejected;
 	// Do tracking (for a subset of trials)
 	Tracker tracker("feasible/output/track.tsv");
-	// Do a number of trial parameter samples
-	for(int trial=0;trial<trials;trial++){
+	// Check the feasibility of a number of trial parameter samples
+	check(check_feasible,trials,[&](){
 		// Randomly sample parameters from priors
 		parameters.randomise();
-		// Check feasibility of parameters
-		check(check_feasible,trial,parameters,data,tracker,accepted,rejected);
-	}
+		return parameters;
+	},data,tracker,accepted,rejected);
 	// Write out
 	accepted.write("feasible/output/accepted.tsv");
 	rejected.write("feasible/output/rejected.tsv");
@@ -366,35 +558,343 @@ void condition_ss3(int replicates=1000){
 	// Read in parameter values from SS3 grid
 	Frame grid;
 	grid.read("ss3/pars.tsv");
+	Parameters::Rows cells(grid);
 	// Frames for accepted and rejected parameter samples
 	Frame accepted;
 	Frame rejected;
 	// Do tracking (for a subset of trials)
 	Tracker tracker("ss3/output/track.tsv");
 	// For each replicate...
-	for(int replicate=0;replicate<replicates;replicate++){
+	check(check_ss3,replicates,[&](){
 		//... randomise parameter values from priors
 		parameters.randomise();
-		//... randomly choose a grid cell
-		Frame cell = grid.slice(
-			Uniform(0,grid.rows()).random()
-		);
-		//... overwrite parameters avialable from grid
-		parameters.read(cell,{"catches"});
-		//... check feasibility of parameters
-		check(check_ss3,replicate,parameters,data,tracker,accepted,rejected);
-	}
+		//... randomly choose a grid cell and
+		//... overwrite parameters avialable from it
+		parameters.read(cells,Uniform(0,cells.rows()).random());
+		return parameters;
+	},data,tracker,accepted,rejected);
 	accepted.write("ss3/output/accepted.tsv");
 	rejected.write("ss3/output/rejected.tsv");
 }
 
-void condition_demc(uint generations,uint logging=1, uint saving=10){
+/**
+ * Calculates the likelihoods of candidate parameter vectors (e.g. for
+ * the proposals of MCMC samplers)
+ *
+ * If `threads` is greater than one, candidates are handed out to a pool of worker threads, each with
+ * its own parameters and data (model predictions are stored there). Errors are written to `errors`
+ * in candidate order (see `Generator`).
+ *
+ * Recruitment variation (in the years after the recruitment deviation years) for each candidate comes from the
+ * random number streams of the replicate given for it (see `Generator`). So each task chooses whether candidates
+ * have independent random numbers (e.g. the proposals of MCMC samplers) or common ones (e.g. the evaluations of
+ * an optimiser, for which the objective then needs to be a deterministic function of the parameters).
+ *
+ * Recruitment deviations only affect the hindcast from their year onwards. So that candidates which
+ * differ from a `base()` candidate only in recruitment deviations (e.g. the finite difference perturbations in
+ * `condition_mpd`) do not need to repeat the whole hindcast, the model and data at the start of each recruitment deviation year
+ * are checkpointed for the base candidate and the hindcast is restarted from the earliest year in which a candidate differs.
+ * Results are identical to those of a full hindcast since there is no random variation before the last recruitment deviation year.
+ *
+ * If a threshold is given for a candidate (e.g. the lowest likelihood at which a DE-MC proposal would be accepted)
+ * then its hindcast is stopped as soon as the upper bound on its likelihood (see `Data::loglike_bound()`) falls below that
+ * threshold, and that bound is returned instead of the likelihood.
+ */
+class Likelihoods {
+public:
+
+	Likelihoods(const Parameters& parameters, const Data& data, std::ostream& errors):
+		parameters_(parameters),
+		data_(data),
+		errors_(errors),
+		years_(parameters_.years()){
+		uint32_t seed = Generator.seed_get();
+		if(threads>1){
+			for(uint thread=0;thread<threads;thread++){
+				workers_.emplace_back([this,seed](){
+					// Workers wait for a new `round_` of candidates and then signal when `finished_`
+					Generator.seed(seed);
+					Parameters parameters = parameters_;
+					Data data = data_;
+					Parameters::Initialised initialised;
+					uint seen = 0;
+					while(true){
+						{
+							std::unique_lock<std::mutex> lock(mutex_);
+							changed_.wait(lock,[&](){ return stop_ or round_>seen; });
+							if(stop_) return;
+							seen = round_;
+						}
+						work_(parameters,data,initialised);
+						std::lock_guard<std::mutex> lock(mutex_);
+						finished_++;
+						changed_.notify_all();
+					}
+				});
+			}
+		}
+	}
+
+	~Likelihoods(void){
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+			changed_.notify_all();
+		}
+		for(auto& worker : workers_) worker.join();
+	}
+
+	/**
+	 * Set the base candidate from which hindcasts are restarted and return its likelihood
+	 * (using the random number streams of `replicate`)
+	 */
+	double base(const std::vector<double>& candidate, uint32_t replicate){
+		base_.clear();
+		base_models_.clear();
+		base_datas_.clear();
+		Parameters parameters = parameters_;
+		Data data = data_;
+		parameters.vector(candidate);
+		Model model;
+		double loglike = NAN;
+		try {
+			for(uint time=0;time<=time_calc(2014,3);time++){
+				uint year = IOSKJ::year(time);
+				if(IOSKJ::quarter(time)==0 and year>=recdev_years.begin() and year<recdev_years.end()){
+					base_models_.push_back(model);
+					base_datas_.push_back(data);
+				}
+				parameters.set(time,model,initialised_);
+				model.update(time,replicate);
+				data.get(time,model);
+			}
+			loglike = parameters.loglike() + data.loglike();
+			base_ = candidate;
+		} catch(...){
+			base_models_.clear();
+			base_datas_.clear();
+		}
+		return loglike;
+	}
+
+	/**
+	 * Calculate the likelihoods for candidates. Likelihoods are NAN for
+	 * candidates for which an error occurred. If `thresholds` are given, the likelihood
+	 * of a candidate is only calculated in full if it is above its threshold.
+	 *
+	 * @param replicates Replicate whose random number streams are used for each candidate
+	 */
+	std::vector<double> calculate(const std::vector<std::vector<double>>& candidates, const std::vector<uint32_t>& replicates, const std::vector<double>& thresholds = {}){
+		if(replicates.size()!=candidates.size()) throw std::runtime_error("Wrong number of replicates: "+std::to_string(replicates.size()));
+		candidates_ = &candidates;
+		replicates_ = &replicates;
+		thresholds_ = &thresholds;
+		loglikes_.assign(candidates.size(),NAN);
+		errors_candidates_.assign(candidates.size(),"");
+		next_ = 0;
+		if(workers_.size()>0){
+			std::unique_lock<std::mutex> lock(mutex_);
+			finished_ = 0;
+			round_++;
+			changed_.notify_all();
+			changed_.wait(lock,[&](){ return finished_==workers_.size(); });
+		} else {
+			work_(parameters_,data_,initialised_);
+		}
+		for(auto& errors : errors_candidates_) errors_<<errors;
+		return loglikes_;
+	}
+
+private:
+
+	Parameters parameters_;
+	Data data_;
+	Parameters::Initialised initialised_;
+	std::ostream& errors_;
+
+	// Year in which each parameter is first used
+	std::vector<uint> years_;
+	// Base candidate and model and data checkpoints at the start of each recruitment deviation year
+	std::vector<double> base_;
+	std::vector<Model> base_models_;
+	std::vector<Data> base_datas_;
+
+	const std::vector<std::vector<double>>* candidates_ = nullptr;
+	const std::vector<uint32_t>* replicates_ = nullptr;
+	const std::vector<double>* thresholds_ = nullptr;
+	std::vector<double> loglikes_;
+	std::vector<std::string> errors_candidates_;
+
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable changed_;
+	std::atomic<uint> next_ {0};
+	uint round_ = 0;
+	uint finished_ = 0;
+	bool stop_ = false;
+
+	// Calculate likelihoods for candidates until there are none left
+	void work_(Parameters& parameters, Data& data, Parameters::Initialised& initialised){
+		uint candidate;
+		while((candidate = next_++)<candidates_->size()) run_(candidate,parameters,data,initialised);
+	}
+
+	// Calculate likelihood for a candidate. Models are initialised incrementally (see `Parameters::Initialised`)
+	// since successive candidates often differ in only a few parameters
+	void run_(uint candidate, Parameters& parameters, Data& data, Parameters::Initialised& initialised){
+    	double loglike = NAN;
+        try {            
+			const std::vector<double>& values = (*candidates_)[candidate];
+        	parameters.vector(values);
+        	double prior = parameters.loglike();
+        	// Hindcasts are stopped when the bound is below the threshold by this margin (to allow for
+        	// rounding error in the sum of the bound)
+        	double threshold = -INFINITY;
+        	if(candidate<thresholds_->size()) threshold = (*thresholds_)[candidate] - 1e-3;
+
+			// Find the year from which the hindcast can be restarted (if any)
+			uint restart = 0;
+			if(base_.size()==values.size()){
+				restart = recdev_years.end()-1;
+				for(uint column=0;column<values.size();column++){
+					if(values[column]!=base_[column]) restart = std::min(restart,years_[column]);
+				}
+			}
+
+			Model model;
+			uint start = 0;
+			if(restart>0){
+				uint checkpoint = restart-recdev_years.begin();
+				model = base_models_[checkpoint];
+				data = base_datas_[checkpoint];
+				start = time_calc(restart,0);
+			}
+			for(uint time=start;time<=time_calc(2014,3);time++){
+				// Do the time step
+				//... set parameters
+				parameters.set(time,model,initialised);
+				//... update the model
+				model.update(time,(*replicates_)[candidate]);
+				//... get data
+				data.get(time,model);
+				//... stop if the candidate's likelihood will be below its threshold
+				double bound = prior + data.loglike_bound();
+				if(bound<threshold){
+					loglike = bound;
+					break;
+				}
+			}
+			// Calculate likelihood
+			if(std::isnan(loglike)) loglike = prior + data.loglike();
+
+        } catch(const std::exception& e){
+        	std::ostringstream errors;
+            errors<<e.what()<<"\n";
+            parameters.values().write(errors);
+            errors<<std::endl;
+            errors_candidates_[candidate] = errors.str();
+        } catch(...){
+        	std::ostringstream errors;
+            errors<<"\"Unknown error\"\n";
+            parameters.values().write(errors);
+            errors<<std::endl;
+            errors_candidates_[candidate] = errors.str();
+        }
+        loglikes_[candidate] = loglike;
+    }
+};
+
+/**
+ * State of a DE-MC run which is saved so that it can be resumed
+ *
+ * Random draws are made from streams addressed by chain and generation so the only
+ * random number generator state required is the seed. The sizes of the output files are recorded so that
+ * lines written after the checkpoint can be removed when resuming.
+ */
+struct DemcCheckpoint {
+	uint32_t seed;
+	uint32_t generation;
+	double blending;
+	double acceptance;
+	uint64_t log_size;
+	uint64_t errors_size;
+	uint64_t trace_size;
+	uint32_t columns;
+	std::vector<double> population;
+	std::vector<double> loglikes;
+
+	/**
+	 * Write the checkpoint to a temporary file and then rename it
+	 * so that an existing checkpoint is only replaced by a complete one
+	 */
+	void write(const std::string& path) const {
+		std::string temp = path+".tmp";
+		{
+			std::ofstream file(temp,std::ios::binary);
+			uint32_t header[4] = {0x434d4544,1,uint32_t(loglikes.size()),columns};
+			file.write(reinterpret_cast<const char*>(header),sizeof(header));
+			file.write(reinterpret_cast<const char*>(&seed),sizeof(seed));
+			file.write(reinterpret_cast<const char*>(&generation),sizeof(generation));
+			file.write(reinterpret_cast<const char*>(&blending),sizeof(blending));
+			file.write(reinterpret_cast<const char*>(&acceptance),sizeof(acceptance));
+			file.write(reinterpret_cast<const char*>(&log_size),sizeof(log_size));
+			file.write(reinterpret_cast<const char*>(&errors_size),sizeof(errors_size));
+			file.write(reinterpret_cast<const char*>(&trace_size),sizeof(trace_size));
+			file.write(reinterpret_cast<const char*>(population.data()),population.size()*sizeof(double));
+			file.write(reinterpret_cast<const char*>(loglikes.data()),loglikes.size()*sizeof(double));
+			file.flush();
+			if(not file.good()) throw std::runtime_error("Error writing checkpoint: "+temp);
+		}
+		boost::filesystem::rename(temp,path);
+	}
+
+	/**
+	 * Read the checkpoint, checking that it is for a population of the 
+	 * expected size
+	 */
+	void read(const std::string& path, uint size, uint columns){
+		std::ifstream file(path,std::ios::binary);
+		if(not file.good()) throw std::runtime_error("Unable to open checkpoint: "+path);
+		uint32_t header[4];
+		file.read(reinterpret_cast<char*>(header),sizeof(header));
+		if(header[0]!=0x434d4544 or header[1]!=1) throw std::runtime_error("Invalid checkpoint: "+path);
+		if(header[2]!=size or header[3]!=columns) throw std::runtime_error("Checkpoint is for a different set of parameters: "+path);
+		file.read(reinterpret_cast<char*>(&seed),sizeof(seed));
+		file.read(reinterpret_cast<char*>(&generation),sizeof(generation));
+		file.read(reinterpret_cast<char*>(&blending),sizeof(blending));
+		file.read(reinterpret_cast<char*>(&acceptance),sizeof(acceptance));
+		file.read(reinterpret_cast<char*>(&log_size),sizeof(log_size));
+		file.read(reinterpret_cast<char*>(&errors_size),sizeof(errors_size));
+		file.read(reinterpret_cast<char*>(&trace_size),sizeof(trace_size));
+		this->columns = columns;
+		population.resize(size*columns);
+		file.read(reinterpret_cast<char*>(population.data()),population.size()*sizeof(double));
+		loglikes.resize(size);
+		file.read(reinterpret_cast<char*>(loglikes.data()),size*sizeof(double));
+		if(not file.good()) throw std::runtime_error("Error reading checkpoint: "+path);
+	}
+};
+
+/**
+ * Condition using Differential Evolution Markov Chain (DE-MC)
+ *
+ * The proposals for all chains in a generation are made from the population at the end of the
+ * previous generation, so their likelihoods can be calculated concurrently (on `threads` worker threads),
+ * before the Metropolis acceptance step is applied to each chain in turn. Random draws for a chain in a
+ * generation come from a stream addressed by chain and generation (see `Generator`).
+ *
+ * Each proposal has its own recruitment variation (see `Likelihoods`): the proposal for a chain in a generation
+ * uses the random number streams of replicate `generation*size+chain` and the initial candidate for a chain those
+ * of replicate `chain`.
+ *
+ * The state of the run is saved to "demc/output/checkpoint.bin" every `checkpointing` seconds, at the end, and
+ * when a SIGTERM or SIGINT is received (after which the run stops at the end of the current generation).
+ * With the `--resume` option the run continues from that checkpoint and gives the same results as an
+ * uninterrupted run.
+ */
+void condition_demc(uint generations,uint logging=1, uint saving=10, uint checkpointing=600){
     // Create output directory
 	boost::filesystem::create_directories("demc/output");
-	// Set up log file
-	std::ofstream log_file("demc/output/log.tsv");
-    std::ofstream errors_file("demc/output/errors.tsv");
-    std::ofstream trace("demc/output/trace.tsv");
 
 	// Read in parameter priors and default values
 	Parameters parameters;
@@ -403,13 +903,44 @@ void condition_demc(uint generations,uint logging=1, uint saving=10){
 	Data data;
 	data.read();
 
+	auto names = parameters.names();
+	auto columns = names.size();
+
+    // Population size (Ter Braak's N)
+	// Default is 2*d
+	unsigned int size = 2*columns;
+
+	// Read checkpoint if resuming and remove any output written after it
+	std::string checkpoint_path = "demc/output/checkpoint.bin";
+	DemcCheckpoint checkpoint;
+	if(resume){
+		checkpoint.read(checkpoint_path,size,columns);
+		Generator.seed(checkpoint.seed);
+		boost::filesystem::resize_file("demc/output/log.tsv",checkpoint.log_size);
+		boost::filesystem::resize_file("demc/output/errors.tsv",checkpoint.errors_size);
+		boost::filesystem::resize_file("demc/output/trace.tsv",checkpoint.trace_size);
+	}
+
+	// Set up log file
+	auto mode = resume?std::ios::app:std::ios::trunc;
+	std::ofstream log_file("demc/output/log.tsv",std::ios::out|mode);
+    std::ofstream errors_file("demc/output/errors.tsv",std::ios::out|mode);
+    std::ofstream trace("demc/output/trace.tsv",std::ios::out|mode);
+    bool log_header = not resume or checkpoint.log_size==0;
+    bool trace_header = not resume or checkpoint.trace_size==0;
+
+	// Stop at the end of a generation on SIGTERM (e.g. `killall -15 ioskj.exe`) or SIGINT
+	interrupted = 0;
+	auto handler = [](int){ interrupted = 1; };
+	std::signal(SIGTERM,handler);
+	std::signal(SIGINT,handler);
+
 	Uniform chance(0,1);
 	Normal error(0,0.01);
 
-	std::vector<std::vector<double>> population;
+	// Population as a row-major matrix with one row of `columns` parameter values for each chain
+	std::vector<double> population;
 	std::vector<double> loglikes;
-	auto names = parameters.names();
-	auto columns = names.size();
 
     // Blending of donor parameter values (Ter Braak's Gamma)
 	// Default is 2.38/sqrt(2*d) jumping to 1
@@ -421,53 +952,71 @@ void condition_demc(uint generations,uint logging=1, uint saving=10){
 	// from mutation
 	double crossing = 0.25;
 
-    // Population size (Ter Braak's N)
-	// Default is 2*d
-	unsigned int size = 2*columns;
-
 	double acceptance = 1;
 
-	auto run = [&](){
-    	// Calculate likelihood for candidate
-    	double loglike = NAN;
-        try {            
+	// Candidate parameter vectors and their likelihoods
+	std::vector<std::vector<double>> candidates;
+	std::vector<double> candidates_loglikes;
+	Likelihoods likelihoods(parameters,data,errors_file);
+	// Calculate the likelihoods of candidates using the random number streams of consecutive replicates
+	std::vector<uint32_t> replicates;
+	auto evaluate = [&](uint32_t replicate, const std::vector<double>& thresholds = {}){
+		replicates.resize(candidates.size());
+		for(uint candidate=0;candidate<candidates.size();candidate++) replicates[candidate] = replicate+candidate;
+		candidates_loglikes = likelihoods.calculate(candidates,replicates,thresholds);
+	};
+	uint32_t seed = Generator.seed_get();
 
-			Model model;
-			for(uint time=0;time<=time_calc(2014,3);time++){
-				// Do the time step
-				//... set parameters
-				parameters.set(time,model);
-				//... update the model
-				model.update(time);
-				//... get data
-				data.get(time,model);
-			}
-			// Calculate likelihood
-			loglike = parameters.loglike() + data.loglike();
+    uint generation = 1;
+    if(resume){
+    	population = checkpoint.population;
+    	loglikes = checkpoint.loglikes;
+    	blending = checkpoint.blending;
+    	acceptance = checkpoint.acceptance;
+    	generation = checkpoint.generation;
+    }
 
-        } catch(const std::exception& e){
-            errors_file<<e.what()<<"\n";
-            parameters.values().write(errors_file);
-            errors_file<<std::endl;
-        } catch(...){
-            errors_file<<"\"Unknown error\"\n";
-            parameters.values().write(errors_file);
-            errors_file<<std::endl;
-        }
-        return loglike;
-    };
-
-    while(population.size()<size){
-    	parameters.randomise();
-    	auto initial = parameters.vector();
-    	auto loglike = run();
-    	if(not std::isfinite(loglike)) continue;
-		population.push_back(initial);
-		loglikes.push_back(loglike);
+	// Save the state of the run
+	auto checkpoint_save = [&](){
+		log_file.flush();
+		errors_file.flush();
+		trace.flush();
+		checkpoint.seed = seed;
+		checkpoint.generation = generation;
+		checkpoint.blending = blending;
+		checkpoint.acceptance = acceptance;
+		checkpoint.log_size = boost::filesystem::file_size("demc/output/log.tsv");
+		checkpoint.errors_size = boost::filesystem::file_size("demc/output/errors.tsv");
+		checkpoint.trace_size = boost::filesystem::file_size("demc/output/trace.tsv");
+		checkpoint.columns = columns;
+		checkpoint.population = population;
+		checkpoint.loglikes = loglikes;
+		checkpoint.write(checkpoint_path);
+	};
+	auto checkpoint_time = std::chrono::steady_clock::now();
+
+    while(loglikes.size()<size){
+    	candidates.clear();
+    	for(uint candidate=loglikes.size();candidate<size;candidate++){
+	    	parameters.randomise();
+	    	candidates.push_back(parameters.vector());
+	    }
+    	evaluate(loglikes.size());
+    	for(uint candidate=0;candidate<candidates.size();candidate++){
+    		auto loglike = candidates_loglikes[candidate];
+	    	if(not std::isfinite(loglike)) continue;
+			population.insert(population.end(),candidates[candidate].begin(),candidates[candidate].end());
+			loglikes.push_back(loglike);
+		}
     }
 
-    uint generation = 1;
-    while(generation<=generations){  
+	// Proposals are made into storage which is reused across generations
+	candidates.assign(size,std::vector<double>(columns));
+	std::vector<double> chances(size);
+	std::vector<double> thresholds(size);
+	std::vector<double> child(columns);
+
+    while(generation<=generations and not interrupted){  
 
     	// Alter blending
     	if(acceptance>0.3) blending /= 0.9;
@@ -479,52 +1028,66 @@ void condition_demc(uint generations,uint logging=1, uint saving=10){
 			blending_now = blending;
 		}
 
-    	uint accepted = 0;
-    	uint trials = 0;
+		// Propose a child for each chain
     	for(uint chain=0; chain<size; chain++){
-	    	std::vector<double> parent = population[chain];
-	    	double parent_loglike = loglikes[chain];
-	    	std::vector<double> child(columns);
+    		Philox stream = Generator.stream(chain,0,generation,purpose_demc);
+
+	    	const double* parent = &population[chain*columns];
 
             // Mutation
-            unsigned int random_1_row = chance.random()*size;
-            unsigned int random_2_row = chance.random()*size;
-           	std::vector<double> random_1 = population[random_1_row];
-            std::vector<double> random_2 = population[random_2_row];
+            unsigned int random_1_row = chance.random(stream)*size;
+            unsigned int random_2_row = chance.random(stream)*size;
+           	const double* random_1 = &population[random_1_row*columns];
+            const double* random_2 = &population[random_2_row*columns];
             for(uint column=0;column<columns;column++){
                 auto value = parent[column];
-                child[column] = value + blending_now*(random_1[column]-random_2[column]) + error.random()*std::fabs(value);
+                child[column] = value + blending_now*(random_1[column]-random_2[column]) + error.random(stream)*std::fabs(value);
             }
 
             // Cross-over
 	        for(uint column=0;column<columns;column++){
-                if(chance.random()<(1-crossing)){
+                if(chance.random(stream)<(1-crossing)){
                     child[column] = parent[column];
                 }
             }
 
             // Set parameters
-           	parameters.vector(child);
+           	parameters.vector_set(child.data());
            	// Bounce parameters off their bounds
             parameters.bounce();
             // Get parameters back after bounce
-			child = parameters.vector();
+			parameters.vector_get(candidates[chain].data());
+
+			// Draw the chance used in the Metropolis acceptance step now so that the child's
+			// hindcast can be stopped once its likelihood is certain to be too low for it to be accepted
+			chances[chain] = chance.random(stream);
+			thresholds[chain] = loglikes[chain] + std::log(chances[chain]);
+		}
 
-	        auto loglike = run();
+		// Calculate likelihoods of children
+		evaluate(generation*size,thresholds);
+
+		// Accept or reject each child
+    	uint accepted = 0;
+    	uint trials = 0;
+    	for(uint chain=0; chain<size; chain++){
+    		const std::vector<double>& child = candidates[chain];
+	    	double parent_loglike = loglikes[chain];
+
+	        auto loglike = candidates_loglikes[chain];
 	        if(not std::isfinite(loglike)) continue;
 
             double ratio = std::exp(loglike-parent_loglike);
-            if(chance.random()<ratio){
+            if(chances[chain]<ratio){
                 accepted++;
-                for(uint column=0;column<columns;column++){
-                	population[chain][column] = child[column];
-                }
+                std::copy(child.begin(),child.end(),&population[chain*columns]);
                 loglikes[chain] = loglike;
                 // Record trace
-                if(trace.tellp()==0){
+                if(trace_header){
                 	trace<<"chain\t";
                 	for(auto name : names) trace<<name<<"\t";
                 	trace<<"loglike"<<"\n";
+                	trace_header = false;
                 }
                 trace<<chain<<"\t";
                 for(uint column=0;column<columns;column++){
@@ -539,9 +1102,12 @@ void condition_demc(uint generations,uint logging=1, uint saving=10){
 
     	// Record log
 		if(generation%logging==0){
-            if(log_file.tellp()==0) log_file<<"generation\trows\tworst\tmean\tbest\tacceptance\tblending"<<std::endl;
+            if(log_header){
+            	log_file<<"generation\trows\tworst\tmean\tbest\tacceptance\tblending"<<std::endl;
+            	log_header = false;
+            }
 	    	// Update stats
-	        uint rows = population.size();
+	        uint rows = loglikes.size();
 	        double sum = 0;
 	        double best = -INFINITY;
 	        double worst = INFINITY;
@@ -565,22 +1131,737 @@ void condition_demc(uint generations,uint logging=1, uint saving=10){
 			std::ofstream save("demc/output/population.tsv");
 			for(auto name : names) save<<name<<"\t";
 			save<<"loglike"<<std::endl;
-			uint index = 0;
-			for(auto row : population){
-				for(auto value : row){
-					save<<value<<"\t";
+			for(uint row=0;row<size;row++){
+				for(uint column=0;column<columns;column++){
+					save<<population[row*columns+column]<<"\t";
 				}
-				save<<loglikes[index++]<<std::endl;
+				save<<loglikes[row]<<std::endl;
 			}
 		}
 
         generation++;
+
+        // Save checkpoint periodically
+        if(std::chrono::steady_clock::now()-checkpoint_time > std::chrono::seconds(checkpointing)){
+        	checkpoint_save();
+        	checkpoint_time = std::chrono::steady_clock::now();
+        }
     }
+    // Save checkpoint at end (or when interrupted) so that the run can be resumed or extended
+    checkpoint_save();
+}
+
+/**
+ * Condition using a DREAM(ZS) sampler (ter Braak and Vrugt 2008)
+ *
+ * Like `condition_demc` but the differences used to make proposals are drawn from a growing archive
+ * of past states rather than from the current population, so that only a few chains are needed. Proposals
+ * are either parallel direction updates of a random subset of parameters (with adaptive crossover probabilities) or,
+ * occasionally, snooker updates. Parallel direction updates can use multiple tries (Laloy and Vrugt 2012): several
+ * proposals are made for each chain, one is selected in proportion to its likelihood, and it is accepted based on 
+ * the likelihoods of those proposals and of reference points drawn from it. The likelihoods of all proposals 
+ * (and then all reference points) in a generation are calculated concurrently on `threads` worker threads.
+ *
+ * As for `condition_demc`, random draws for a chain in a generation come from a stream addressed by
+ * chain and generation. Each candidate (initial state, proposal or reference point) has its own recruitment
+ * variation (see `Likelihoods`): the candidates are numbered in the order in which they are made and each
+ * uses the random number streams of the replicate with its number.
+ *
+ * @param generations Number of generations
+ * @param chains Number of chains
+ * @param tries Number of tries for parallel direction updates
+ */
+void condition_dreamzs(uint generations, uint chains=3, uint tries=5, uint logging=1, uint saving=10){
+    // Create output directory
+	boost::filesystem::create_directories("dreamzs/output");
+	// Set up log file
+	std::ofstream log_file("dreamzs/output/log.tsv");
+    std::ofstream errors_file("dreamzs/output/errors.tsv");
+    std::ofstream trace("dreamzs/output/trace.tsv");
+
+	// Read in parameter priors and default values
+	Parameters parameters;
+	parameters.read();
+	// Read in data
+	Data data;
+	data.read();
+
+	auto names = parameters.names();
+	auto columns = names.size();
+
+	Uniform chance(0,1);
+	Uniform stretch(-0.1,0.1);
+	Uniform snooker_stretch(1.2,2.2);
+	Normal error(0,1e-6);
+
+	// Probability of a snooker update
+	double snooker = 0.1;
+	// Number of generations between additions of chain states to the archive
+	uint thinning = 10;
+	// Number of crossover values (1/crossovers, 2/crossovers ... 1)
+	const uint crossovers = 3;
+	// Number of generations during which crossover probabilities are adapted
+	uint adapting = generations/10;
+
+	Likelihoods likelihoods(parameters,data,errors_file);
+	// Calculate the likelihoods of candidates using the random number streams of the next replicates
+	uint32_t replicate = 0;
+	auto calculate = [&](const std::vector<std::vector<double>>& candidates){
+		std::vector<uint32_t> replicates(candidates.size());
+		for(auto& item : replicates) item = replicate++;
+		return likelihoods.calculate(candidates,replicates);
+	};
+
+	// Initialise archive with samples from priors
+	std::vector<std::vector<double>> archive;
+	for(uint sample=0;sample<10*columns;sample++){
+		parameters.randomise();
+		archive.push_back(parameters.vector());
+	}
+
+	// Scale of each parameter in the initial archive, used to standardise
+	// jump distances when adapting crossover probabilities
+	std::vector<double> scales(columns);
+	for(uint column=0;column<columns;column++){
+		double sum = 0;
+		double squares = 0;
+		for(const auto& sample : archive){
+			sum += sample[column];
+			squares += sample[column]*sample[column];
+		}
+		double mean = sum/archive.size();
+		double scale = std::sqrt(squares/archive.size()-mean*mean);
+		scales[column] = (std::isfinite(scale) and scale>0)?scale:1;
+	}
+
+	// Initialise chains with samples from priors that have a finite likelihood
+	std::vector<std::vector<double>> states;
+	std::vector<double> loglikes;
+	while(states.size()<chains){
+		std::vector<std::vector<double>> candidates;
+		for(uint chain=states.size();chain<chains;chain++){
+			parameters.randomise();
+			candidates.push_back(parameters.vector());
+		}
+		auto candidates_loglikes = calculate(candidates);
+		for(uint candidate=0;candidate<candidates.size();candidate++){
+			if(not std::isfinite(candidates_loglikes[candidate])) continue;
+			states.push_back(candidates[candidate]);
+			loglikes.push_back(candidates_loglikes[candidate]);
+		}
+	}
+
+	// Crossover probabilities and the statistics used to adapt them
+	std::vector<double> crossover_probs(crossovers,1.0/crossovers);
+	std::vector<double> crossover_jumps(crossovers,0);
+	std::vector<double> crossover_uses(crossovers,0);
+
+	// Randomly select a state from the archive
+	auto archived = [&](Philox& stream) -> const std::vector<double>& {
+		return archive[uint(chance.random(stream)*archive.size())];
+	};
+
+	// Make a parallel direction proposal from `from` by updating
+	// the parameters selected by crossover
+	auto parallel = [&](const std::vector<double>& from, double crossover, Philox& stream){
+		std::vector<bool> selected(columns);
+		uint count = 0;
+		for(uint column=0;column<columns;column++){
+			selected[column] = chance.random(stream)<crossover;
+			if(selected[column]) count++;
+		}
+		if(count==0){
+			selected[uint(chance.random(stream)*columns)] = true;
+			count = 1;
+		}
+		double jump = (chance.random(stream)<0.2)?1:2.38/std::sqrt(2*count);
+		const std::vector<double>& a = archived(stream);
+		const std::vector<double>& b = archived(stream);
+		double scale = (1+stretch.random(stream))*jump;
+		std::vector<double> to = from;
+		for(uint column=0;column<columns;column++){
+			if(selected[column]){
+				to[column] += scale*(a[column]-b[column]) + error.random(stream)*std::fabs(from[column]);
+			}
+		}
+		parameters.vector(to);
+		parameters.bounce();
+		return parameters.vector();
+	};
+
+	// Log of the sum of exponentials of log likelihoods (treating 
+	// non-finite values as zero likelihood)
+	auto logsumexp = [](const std::vector<double>& values) -> double {
+		double max = -INFINITY;
+		for(auto value : values) if(std::isfinite(value)) max = std::max(max,value);
+		if(not std::isfinite(max)) return -INFINITY;
+		double sum = 0;
+		for(auto value : values) if(std::isfinite(value)) sum += std::exp(value-max);
+		return max + std::log(sum);
+	};
+
+	// Proposal for a chain
+	struct Proposal {
+		bool snooker;
+		uint crossover;
+		// Index of first try in candidates and number of tries
+		uint first;
+		uint count;
+		// Selected try and index of first reference point
+		uint selected;
+		uint references;
+		// Log of snooker update jacobian
+		double jacobian;
+	};
+
+	double acceptance = 1;
+	for(uint generation=1;generation<=generations;generation++){
+
+		// Make proposals for each chain
+		std::vector<Philox> streams;
+		std::vector<Proposal> proposals(chains);
+		std::vector<std::vector<double>> candidates;
+		for(uint chain=0;chain<chains;chain++){
+			streams.push_back(Generator.stream(chain,0,generation,purpose_dreamzs));
+			Philox& stream = streams.back();
+			Proposal& proposal = proposals[chain];
+			const std::vector<double>& state = states[chain];
+			proposal.first = candidates.size();
+			proposal.snooker = chance.random(stream)<snooker;
+			if(proposal.snooker){
+				// Snooker update along the line through the state and an archived state
+				const std::vector<double>& z = archived(stream);
+				const std::vector<double>& a = archived(stream);
+				const std::vector<double>& b = archived(stream);
+				double norm = 0;
+				double projection = 0;
+				for(uint column=0;column<columns;column++){
+					double direction = state[column]-z[column];
+					norm += direction*direction;
+					projection += (a[column]-b[column])*direction;
+				}
+				double scale = (norm>0)?snooker_stretch.random(stream)*projection/norm:0;
+				std::vector<double> to(columns);
+				for(uint column=0;column<columns;column++){
+					to[column] = state[column] + scale*(state[column]-z[column]);
+				}
+				parameters.vector(to);
+				parameters.bounce();
+				to = parameters.vector();
+				double distance = 0;
+				for(uint column=0;column<columns;column++) distance += std::pow(to[column]-z[column],2);
+				proposal.jacobian = (norm>0 and distance>0)?(columns-1)*0.5*(std::log(distance)-std::log(norm)):0;
+				candidates.push_back(to);
+				proposal.count = 1;
+			} else {
+				// Choose crossover
+				double pick = chance.random(stream);
+				proposal.crossover = 0;
+				for(double cumulative = crossover_probs[0]; pick>cumulative and proposal.crossover<crossovers-1; ){
+					cumulative += crossover_probs[++proposal.crossover];
+				}
+				double crossover = (proposal.crossover+1.0)/crossovers;
+				for(uint attempt=0;attempt<tries;attempt++){
+					candidates.push_back(parallel(state,crossover,stream));
+				}
+				proposal.count = tries;
+			}
+		}
+
+		// Calculate likelihoods of proposals
+		auto candidates_loglikes = calculate(candidates);
+
+		// For multiple try proposals, select one of the tries and draw
+		// reference points from it
+		std::vector<std::vector<double>> references;
+		for(uint chain=0;chain<chains;chain++){
+			Proposal& proposal = proposals[chain];
+			Philox& stream = streams[chain];
+			proposal.selected = proposal.first;
+			if(proposal.count>1){
+				std::vector<double> tries_loglikes(
+					candidates_loglikes.begin()+proposal.first,
+					candidates_loglikes.begin()+proposal.first+proposal.count
+				);
+				double total = logsumexp(tries_loglikes);
+				if(not std::isfinite(total)) continue;
+				double pick = chance.random(stream);
+				double cumulative = 0;
+				for(uint attempt=0;attempt<proposal.count;attempt++){
+					double loglike = tries_loglikes[attempt];
+					if(not std::isfinite(loglike)) continue;
+					cumulative += std::exp(loglike-total);
+					proposal.selected = proposal.first+attempt;
+					if(pick<cumulative) break;
+				}
+				proposal.references = references.size();
+				double crossover = (proposal.crossover+1.0)/crossovers;
+				for(uint attempt=1;attempt<proposal.count;attempt++){
+					references.push_back(parallel(candidates[proposal.selected],crossover,stream));
+				}
+			}
+		}
+		auto references_loglikes = calculate(references);
+
+		// Accept or reject each proposal
+		uint accepted = 0;
+		for(uint chain=0;chain<chains;chain++){
+			Proposal& proposal = proposals[chain];
+			Philox& stream = streams[chain];
+			std::vector<double>& state = states[chain];
+			const std::vector<double>& child = candidates[proposal.selected];
+			double loglike = candidates_loglikes[proposal.selected];
+			if(not proposal.snooker) crossover_uses[proposal.crossover]++;
+			if(not std::isfinite(loglike)) continue;
+
+			double ratio;
+			if(proposal.snooker){
+				ratio = loglike - loglikes[chain] + proposal.jacobian;
+			} else if(proposal.count>1){
+				std::vector<double> tries_loglikes(
+					candidates_loglikes.begin()+proposal.first,
+					candidates_loglikes.begin()+proposal.first+proposal.count
+				);
+				std::vector<double> reference_loglikes(
+					references_loglikes.begin()+proposal.references,
+					references_loglikes.begin()+proposal.references+proposal.count-1
+				);
+				reference_loglikes.push_back(loglikes[chain]);
+				ratio = logsumexp(tries_loglikes) - logsumexp(reference_loglikes);
+			} else {
+				ratio = loglike - loglikes[chain];
+			}
+
+			if(chance.random(stream)<std::exp(ratio)){
+				accepted++;
+				if(not proposal.snooker){
+					double jump = 0;
+					for(uint column=0;column<columns;column++) jump += std::pow((child[column]-state[column])/scales[column],2);
+					crossover_jumps[proposal.crossover] += jump;
+				}
+				state = child;
+				loglikes[chain] = loglike;
+                // Record trace
+                if(trace.tellp()==0){
+                	trace<<"chain\t";
+                	for(auto name : names) trace<<name<<"\t";
+                	trace<<"loglike"<<"\n";
+                }
+                trace<<chain<<"\t";
+                for(uint column=0;column<columns;column++){
+					trace<<child[column]<<"\t";
+                }
+                trace<<loglike<<"\n";
+			}
+		}
+		acceptance = accepted/double(chains);
+
+		// Adapt crossover probabilities in proportion to the mean standardised
+		// jump distance for each crossover value
+		if(generation<=adapting){
+			std::vector<double> rates(crossovers,0);
+			double total = 0;
+			for(uint crossover=0;crossover<crossovers;crossover++){
+				if(crossover_uses[crossover]>0) rates[crossover] = crossover_jumps[crossover]/crossover_uses[crossover];
+				total += rates[crossover];
+			}
+			if(total>0){
+				// Keep a minimum probability so that no crossover value is abandoned
+				for(uint crossover=0;crossover<crossovers;crossover++){
+					crossover_probs[crossover] = 0.9*rates[crossover]/total + 0.1/crossovers;
+				}
+			}
+		}
+
+		// Add chain states to archive
+		if(generation%thinning==0){
+			for(const auto& state : states) archive.push_back(state);
+		}
+
+    	// Record log
+		if(generation%logging==0){
+            if(log_file.tellp()==0){
+            	log_file<<"generation\tchains\tworst\tmean\tbest\tacceptance\tarchive";
+            	for(uint crossover=0;crossover<crossovers;crossover++) log_file<<"\tcrossover_"<<crossover+1;
+            	log_file<<std::endl;
+            }
+	        double sum = 0;
+	        double best = -INFINITY;
+	        double worst = INFINITY;
+	        for(auto loglike : loglikes){
+	            sum += loglike;
+	            best = std::max(loglike,best);
+	            worst = std::min(loglike,worst);
+	        };
+            log_file<<generation<<"\t"
+            	<<chains<<"\t"
+            	<<worst<<"\t"<<sum/chains<<"\t"<<best<<"\t"
+            	<<acceptance<<"\t"
+            	<<archive.size();
+            for(auto prob : crossover_probs) log_file<<"\t"<<prob;
+            log_file<<std::endl;
+        }
+
+        // Save chain states
+		if(generation==generations or generation%saving==0){
+			std::ofstream save("dreamzs/output/population.tsv");
+			for(auto name : names) save<<name<<"\t";
+			save<<"loglike"<<std::endl;
+			for(uint chain=0;chain<chains;chain++){
+				for(auto value : states[chain]) save<<value<<"\t";
+				save<<loglikes[chain]<<std::endl;
+			}
+		}
+	}
+}
+
+/**
+ * Condition by finding the maximum of the posterior density (MPD)
+ *
+ * The log posterior (`Parameters::loglike()` plus `Data::loglike()`) is maximised over the parameters which are
+ * not fixed, within the bounds of their priors (`Parameters::minimums()` and `Parameters::maximums()`), using a
+ * projected limited memory quasi-Newton method (projected L-BFGS: the L-BFGS direction over the parameters which
+ * are not held at a bound is searched along its projection onto the bounds; there is no Cauchy point or subspace
+ * minimisation as in L-BFGS-B). If that direction is not one of descent, projected steepest descent is used instead.
+ * Parameters are scaled by the width of their bounds (when finite) so that they are of similar magnitude.
+ * Gradients are calculated by finite differences and the 2d perturbed parameter vectors are evaluated concurrently
+ * (on `threads` worker threads), as are a set of step lengths in each line search (the largest acceptable one
+ * is used, rather than the first to finish, see `Generator`).
+ * Random recruitment in the last years of the hindcast comes from the same random number streams, those of replicate 0,
+ * for every evaluation (see `Likelihoods`) so, for a given `--seed`, the objective is a smooth function of the parameters.
+ *
+ * At the MPD the Hessian is calculated by finite differences and inverted to give the covariance
+ * matrix of a Laplace (multivariate normal) approximation to the posterior. Parameters which are within a
+ * finite difference step of a bound are excluded from the Hessian and have zero variance (and zero covariance
+ * with other parameters). Parameters for which the Hessian is not positive definite have undefined (NaN) covariances
+ * (see `Laplace`).
+ *
+ * @param iterations Maximum number of iterations
+ * @param tolerance Convergence tolerance for the largest projected gradient (in scaled units)
+ */
+void condition_mpd(uint iterations=1000, double tolerance=1e-3){
+    // Create output directory
+	boost::filesystem::create_directories("mpd/output");
+	std::ofstream log_file("mpd/output/log.tsv");
+    std::ofstream errors_file("mpd/output/errors.tsv");
+
+	// Read in parameter priors and default values
+	Parameters parameters;
+	parameters.read();
+	// Read in data
+	Data data;
+	data.read();
+
+	auto names = parameters.names();
+	uint columns = names.size();
+
+	// Scale parameters to the width of their bounds
+	auto minimums = parameters.minimums();
+	auto maximums = parameters.maximums();
+	std::vector<double> scales(columns);
+	std::vector<double> lower(columns);
+	std::vector<double> upper(columns);
+	for(uint column=0;column<columns;column++){
+		double width = maximums[column]-minimums[column];
+		scales[column] = (std::isfinite(width) and width>0)?width:1;
+		lower[column] = minimums[column]/scales[column];
+		upper[column] = maximums[column]/scales[column];
+	}
+
+	// Size of finite difference steps (in scaled units) for the gradient and Hessian
+	const double gradient_step = 1e-5;
+	const double hessian_step = 1e-4;
+	// Number of corrections kept for the limited memory Hessian approximation
+	const uint memory = 10;
+	// Sufficient decrease parameter for line searches
+	const double armijo = 1e-4;
+	// Maximum number of step length halvings in a line search
+	const uint halvings = 40;
+
+	Likelihoods likelihoods(parameters,data,errors_file);
+	uint evaluations = 0;
+
+	// Calculate the objective (the negative log posterior) for a set of points in scaled units
+	auto objectives = [&](const std::vector<std::vector<double>>& points){
+		std::vector<std::vector<double>> candidates(points.size(),std::vector<double>(columns));
+		for(uint point=0;point<points.size();point++){
+			for(uint column=0;column<columns;column++) candidates[point][column] = points[point][column]*scales[column];
+		}
+		auto loglikes = likelihoods.calculate(candidates,std::vector<uint32_t>(candidates.size(),0));
+		evaluations += points.size();
+		std::vector<double> values(points.size());
+		for(uint point=0;point<points.size();point++){
+			values[point] = std::isfinite(loglikes[point])?-loglikes[point]:INFINITY;
+		}
+		return values;
+	};
+
+	// Set the base from which hindcasts are restarted to a point (in scaled units)
+	// so that the perturbations of recruitment deviations around it are faster to evaluate
+	auto base = [&](const std::vector<double>& point){
+		std::vector<double> candidate(columns);
+		for(uint column=0;column<columns;column++) candidate[column] = point[column]*scales[column];
+		likelihoods.base(candidate,0);
+		evaluations++;
+	};
+
+	// Project a point onto the bounds
+	auto project = [&](std::vector<double> point){
+		for(uint column=0;column<columns;column++) point[column] = std::min(std::max(point[column],lower[column]),upper[column]);
+		return point;
+	};
+
+	// Calculate the gradient of the objective, using central differences
+	// except where a step would cross a bound or give a non-finite objective
+	auto gradient = [&](const std::vector<double>& point, double value){
+		base(point);
+		std::vector<std::vector<double>> points;
+		for(uint column=0;column<columns;column++){
+			auto below = point;
+			auto above = point;
+			below[column] = std::max(point[column]-gradient_step,lower[column]);
+			above[column] = std::min(point[column]+gradient_step,upper[column]);
+			points.push_back(below);
+			points.push_back(above);
+		}
+		auto values = objectives(points);
+		std::vector<double> gradient(columns,0);
+		for(uint column=0;column<columns;column++){
+			double below = points[2*column][column];
+			double above = points[2*column+1][column];
+			double below_value = values[2*column];
+			double above_value = values[2*column+1];
+			if(not std::isfinite(below_value)){
+				below = point[column];
+				below_value = value;
+			}
+			if(not std::isfinite(above_value)){
+				above = point[column];
+				above_value = value;
+			}
+			if(above>below) gradient[column] = (above_value-below_value)/(above-below);
+		}
+		return gradient;
+	};
+
+	auto dot = [&](const std::vector<double>& a, const std::vector<double>& b){
+		double sum = 0;
+		for(uint column=0;column<columns;column++) sum += a[column]*b[column];
+		return sum;
+	};
+
+	// Start at the default parameter values
+	auto point = parameters.vector();
+	for(uint column=0;column<columns;column++) point[column] /= scales[column];
+	point = project(point);
+	double value = objectives({point})[0];
+	if(not std::isfinite(value)) throw std::runtime_error("Log posterior is not finite at the initial parameter values");
+	auto grad = gradient(point,value);
+
+	// Corrections (changes in point and gradient) for the limited memory Hessian approximation
+	std::vector<std::vector<double>> point_changes;
+	std::vector<std::vector<double>> gradient_changes;
+
+	log_file<<"iteration\tloglike\tgradient\tlength\tevaluations"<<std::endl;
+	double length = 0;
+	bool converged = false;
+	for(uint iteration=0;iteration<=iterations;iteration++){
+		// Determine which parameters are free (i.e. not held at a bound by the gradient)
+		// and the largest component of the projected gradient
+		std::vector<bool> free(columns);
+		double projected = 0;
+		for(uint column=0;column<columns;column++){
+			free[column] = not (
+				(point[column]<=lower[column] and grad[column]>0) or 
+				(point[column]>=upper[column] and grad[column]<0)
+			);
+			double moved = std::min(std::max(point[column]-grad[column],lower[column]),upper[column])-point[column];
+			projected = std::max(projected,std::fabs(moved));
+		}
+
+		log_file<<iteration<<"\t"<<-value<<"\t"<<projected<<"\t"<<length<<"\t"<<evaluations<<std::endl;
+		std::cout<<iteration<<"\t"<<-value<<"\t"<<projected<<std::endl;
+
+		if(projected<tolerance){
+			converged = true;
+			break;
+		}
+		if(iteration==iterations) break;
+
+		// Line search along the projected path of a search direction. Step lengths are
+		// tried in batches (halving each time) and the largest acceptable one is used
+		std::vector<double> point_next;
+		double value_next = NAN;
+		while(true){
+			// Search direction from the limited memory BFGS two-loop recursion over free parameters
+			std::vector<double> direction(columns,0);
+			for(uint column=0;column<columns;column++) if(free[column]) direction[column] = grad[column];
+			uint corrections = point_changes.size();
+			std::vector<double> alphas(corrections);
+			for(int index=corrections-1;index>=0;index--){
+				alphas[index] = dot(point_changes[index],direction)/dot(gradient_changes[index],point_changes[index]);
+				for(uint column=0;column<columns;column++) if(free[column]) direction[column] -= alphas[index]*gradient_changes[index][column];
+			}
+			if(corrections>0){
+				const auto& point_change = point_changes.back();
+				const auto& gradient_change = gradient_changes.back();
+				double gamma = dot(point_change,gradient_change)/dot(gradient_change,gradient_change);
+				for(auto& item : direction) item *= gamma;
+			}
+			for(uint index=0;index<corrections;index++){
+				double beta = dot(gradient_changes[index],direction)/dot(gradient_changes[index],point_changes[index]);
+				for(uint column=0;column<columns;column++) if(free[column]) direction[column] += (alphas[index]-beta)*point_changes[index][column];
+			}
+			for(auto& item : direction) item = -item;
+			// Poorly conditioned corrections can give a direction which is not one of descent
+			// so discard them and use steepest descent instead
+			if(corrections>0 and not(dot(grad,direction)<0)){
+				point_changes.clear();
+				gradient_changes.clear();
+				continue;
+			}
+
+			// Initial step length of one for quasi-Newton directions but limited to a
+			// change of 0.1 (10% of the range of a bounded parameter) for steepest descent directions
+			double largest = 0;
+			for(auto item : direction) largest = std::max(largest,std::fabs(item));
+			length = (corrections>0)?1:std::min(1.0,0.1/largest);
+
+			uint batch = std::max(threads,1u);
+			for(uint halving=0;halving<halvings and point_next.size()==0;halving+=batch){
+				std::vector<std::vector<double>> points;
+				for(uint trial=0;trial<batch;trial++){
+					std::vector<double> trial_point(columns);
+					for(uint column=0;column<columns;column++) trial_point[column] = point[column]+length*direction[column];
+					points.push_back(project(trial_point));
+					length *= 0.5;
+				}
+				auto values = objectives(points);
+				length /= std::pow(0.5,batch);
+				for(uint trial=0;trial<batch;trial++){
+					std::vector<double> change(columns);
+					for(uint column=0;column<columns;column++) change[column] = points[trial][column]-point[column];
+					if(values[trial]<=value+armijo*dot(grad,change)){
+						point_next = points[trial];
+						value_next = values[trial];
+						break;
+					}
+					length *= 0.5;
+				}
+			}
+			if(point_next.size()>0 or corrections==0) break;
+			// Line search failed so discard the Hessian approximation and try again with steepest descent
+			point_changes.clear();
+			gradient_changes.clear();
+		}
+		// Stop if no progress can be made along the steepest descent direction
+		if(point_next.size()==0) break;
+
+		auto grad_next = gradient(point_next,value_next);
+
+		// Update corrections, skipping those which would not keep the approximation positive definite
+		std::vector<double> point_change(columns);
+		std::vector<double> gradient_change(columns);
+		for(uint column=0;column<columns;column++){
+			point_change[column] = point_next[column]-point[column];
+			gradient_change[column] = grad_next[column]-grad[column];
+		}
+		if(dot(point_change,gradient_change)>1e-10*dot(gradient_change,gradient_change)){
+			point_changes.push_back(point_change);
+			gradient_changes.push_back(gradient_change);
+			if(point_changes.size()>memory){
+				point_changes.erase(point_changes.begin());
+				gradient_changes.erase(gradient_changes.begin());
+			}
+		}
+
+		point = point_next;
+		value = value_next;
+		grad = grad_next;
+	}
+	if(not converged) std::cout<<"Warning: MPD search stopped before convergence\n";
+
+	// Write the MPD
+	{
+		std::ofstream file("mpd/output/mpd.tsv");
+		for(auto name : names) file<<name<<"\t";
+		file<<"loglike"<<std::endl;
+		file.precision(17);
+		for(uint column=0;column<columns;column++) file<<point[column]*scales[column]<<"\t";
+		file<<-value<<std::endl;
+	}
+
+	// Calculate the Hessian (in scaled units) for parameters which can be
+	// perturbed without crossing a bound
+	std::vector<uint> included;
+	for(uint column=0;column<columns;column++){
+		if(point[column]-hessian_step>=lower[column] and point[column]+hessian_step<=upper[column]) included.push_back(column);
+	}
+	uint size = included.size();
+	base(point);
+	std::vector<std::vector<double>> points;
+	auto perturbed = [&](int first, int first_sign, int second, int second_sign){
+		auto perturbed = point;
+		perturbed[included[first]] += first_sign*hessian_step;
+		if(second>=0) perturbed[included[second]] += second_sign*hessian_step;
+		return perturbed;
+	};
+	for(uint row=0;row<size;row++){
+		points.push_back(perturbed(row,1,-1,0));
+		points.push_back(perturbed(row,-1,-1,0));
+		for(uint col=row+1;col<size;col++){
+			points.push_back(perturbed(row,1,col,1));
+			points.push_back(perturbed(row,1,col,-1));
+			points.push_back(perturbed(row,-1,col,1));
+			points.push_back(perturbed(row,-1,col,-1));
+		}
+	}
+	auto values = objectives(points);
+	std::vector<std::vector<double>> hessian(size,std::vector<double>(size));
+	uint index = 0;
+	for(uint row=0;row<size;row++){
+		hessian[row][row] = (values[index]-2*value+values[index+1])/(hessian_step*hessian_step);
+		index += 2;
+		for(uint col=row+1;col<size;col++){
+			hessian[row][col] = hessian[col][row] = (values[index]-values[index+1]-values[index+2]+values[index+3])/(4*hessian_step*hessian_step);
+			index += 4;
+		}
+	}
+
+	// Invert the Hessian (see `Laplace` for how parameters excluded from it, or
+	// for which it is not positive definite, are treated)
+	Laplace laplace(hessian,included,scales);
+	for(uint row : laplace.dropped){
+		std::cout<<"Warning: Hessian is not positive definite for "<<names[included[row]]<<" so it is dropped from the covariance\n";
+	}
+	uint count = laplace.kept.size();
+
+	// Write the covariance matrix (in parameter units)
+	{
+		const auto& covariance = laplace.covariance;
+		std::ofstream file("mpd/output/covariance.tsv");
+		for(uint column=0;column<columns;column++) file<<names[column]<<((column<columns-1)?"\t":"\n");
+		file.precision(17);
+		for(uint row=0;row<columns;row++){
+			for(uint col=0;col<columns;col++) file<<covariance[row][col]<<((col<columns-1)?"\t":"\n");
+		}
+	}
+
+	// Laplace approximation of the log marginal likelihood
+	double log_marginal = -value + 0.5*count*std::log(2*M_PI) - 0.5*laplace.log_determinant;
+	std::cout<<"MPD log posterior: "<<-value<<"\n"
+			<<"Laplace log marginal likelihood: "<<log_marginal<<"\n"
+			<<"Function evaluations: "<<evaluations<<"\n";
 }
 
 /**
  * Evaluate management procedures
  *
+ * Replicates are independent of one another so, if `threads` is greater than one,
+ * they are handed out to a pool of worker threads. The parameter sample for each replicate
+ * is drawn up front, and random variation within a replicate comes from random number streams
+ * addressed by replicate, procedure and time (see `Generator`).
+ *
  * @param vary Should replicates vary? Should only be set to false for testing
  * @param msy Should msy be calculated for each replicate?
  */
@@ -605,13 +1886,19 @@ void evaluate(
 	Frame samples_all;
 	samples_all.read(samples_file);
 	samples_all.write("evaluate/output/samples_all.tsv");
+	Parameters::Rows samples_rows(samples_all);
 	Frame samples;
 	// Frame for holding reference points
-	Frame references({
+	std::vector<std::string> references_names = {
 		"b0",
 		"e_msy","f_msy","msy","b_msy",
 		"e_40","f_40","b_40"
-	});
+	};
+	Frame references(references_names);
+	// Cache of reference points so that they are only calculated
+	// once for each parameter sample
+	References references_cache;
+	if(references_persist) references_cache.read("evaluate/output/references_cache.tsv");
 	// Setup procedures
 	Procedures procedures;
 	if(procedures_read) procedures.read();
@@ -624,42 +1911,74 @@ void evaluate(
 	uint time_start;
 	if(year_start<0) time_start = time_calc(2015,0);
 	else time_start = time_calc(year_start,0);
-	// For each replicate...
-	for(int replicate=0;replicate<replicates;replicate++){
-		std::cout<<replicate<<std::endl;
+	// Candidate procedures to evaluate
+	uint procedure_begin = 0;
+	uint procedure_end = procedures.size()-1;
+	if(procedure_select>=0){
+		procedure_begin = procedure_select;
+		procedure_end = procedure_select;
+	}
+
+	// Inputs and outputs for each replicate. Outputs are held here until
+	// all previous replicates have been written out.
+	struct Replicate {
+		uint row;
+
+		Frame sample;
+		Frame reference;
+		std::vector<Performance> performances;
+		std::string track;
+		std::exception_ptr error;
+		bool done = false;
+	};
+	std::vector<Replicate> reps(replicates);
+	for(auto& rep : reps){
 		// Randomly select a parameter sample
-		Frame sample = samples_all.slice(
-			vary?Uniform(0,samples_all.rows()).random():0
-		);
+		rep.row = vary?Uniform(0,samples_all.rows()).random():0;
+	}
+	// Snapshots of the deterministic part of the hindcast for each sample (see `snapshots()`).
+	// Tracked replicates are always simulated from time 0 so that their tracks are complete.
+	Snapshots snapshots;
+	snapshots.open(samples_file);
+	// Seed used by all threads for addressed random number streams
+	uint32_t seed = Generator.seed_get();
+
+	// Simulate a single replicate
+	auto simulate = [&](int replicate, Parameters& parameters, Procedures& procedures){
+		Replicate& rep = reps[replicate];
+		// Procedures are simulated together in batches
+		std::unique_ptr<ModelBatch<lanes>> batch(new ModelBatch<lanes>());
+		std::ostringstream track;
 		// Read parameters from sample 
-		// (to save time don't attempt to read catches array)
-		parameters.read(sample,{"catches"});
+		parameters.read(samples_rows,rep.row);
 		// Save samples from parameters after having
 		// been read
-		samples.append(parameters.values());
-		// Generate a random seed to be used to ensure any stochastic
-		// variations is same for all procedures. Placed here so, if necessary
-		// can be made constant for all replicates for testing purposes
-		uint seed = vary?Uniform(0,1e10).random():10000;
-		Generator.seed(seed);
+		rep.sample = parameters.values();
+		// Random number streams for this replicate. If not varying
+		// replicates then use the same streams for all of them (for testing purposes)
+		uint32_t streams = vary?replicate:0;
 		// Create a model representing current state by iterating
-		// from time 0 to now...
+		// from time 0 (or from the snapshot for the sample, if available) to now...
 		Model current;
-		for(uint time=0;time<time_start;time++){
+		uint time_from = 0;
+		if(snapshots.valid() and Snapshots::time()<=time_start and replicate>=100){
+			snapshots.get(rep.row,current);
+			time_from = Snapshots::time();
+		}
+		for(uint time=time_from;time<time_start;time++){
 			//... set parameters
 			parameters.set(time,current); 
 			//... update the model
-			current.update(time);
+			current.update(time,streams);
 			//... track the model (for speed, only track some replicates)
-			if(replicate<100) tracker.get(replicate,-1,time,current);
+			if(replicate<100) Tracker::get(track,replicate,-1,time,current);
 		}
 		// Determine reference points
 		if (refs_calc) {
-			current.msy_find();
-			current.b40_find();
+			references_cache.find(current);
 		}
 		// Record reference points for replicate
-		references.append({
+		rep.reference = Frame(references_names,{
 			sum(current.biomass_spawners_unfished),
 			current.e_msy,
 			current.f_msy,
@@ -669,64 +1988,175 @@ void evaluate(
 			current.f_40,
 			current.biomass_spawners_40,
 		});
-		// For each candidate procedure...
-		uint procedure_begin = 0;
-		uint procedure_end = procedures.size()-1;
-		if(procedure_select>=0){
-			procedure_begin = procedure_select;
-			procedure_end = procedure_select;
-		}
-		for(uint procedure=procedure_begin;procedure<=procedure_end;procedure++){
-			// Create a model with current state to use to 
-			// simulate procedure
-			Model future = current;
-			// Due to lags MP may not set catches for some time, so in the meantime
-			// assume constant effort same level as average of 2005-2014 levels
-			future.effort_set(100);
-			// Set up performance statistics
-			Performance performance(replicate,procedure);
-			// Reset random seed
-			Generator.seed(seed);
-			// Reset the procedure
-			Procedure* procedure_ptr = procedures[procedure];
-			procedure_ptr->reset(time_start,future);
+		// For each batch of candidate procedures...
+		for(uint first=procedure_begin;first<=procedure_end;first+=lanes){
+			uint count = std::min(lanes,procedure_end+1-first);
+			std::vector<Model> futures(count,current);
+			std::vector<Performance> performances_lanes;
+			std::vector<Procedure*> procedure_ptrs(count);
+			std::ostringstream tracks[lanes];
+			for(uint lane=0;lane<count;lane++){
+				uint procedure = first+lane;
+				// Create a model with current state to use to 
+				// simulate procedure
+				Model& future = futures[lane];
+				// Due to lags MP may not set catches for some time, so in the meantime
+				// assume constant effort same level as average of 2005-2014 levels
+				future.effort_set(100);
+				// Set up performance statistics
+				performances_lanes.push_back(Performance(replicate,procedure));
+				// Select the random number streams for this procedure. Recruitment variation
+				// is common to all procedures (see `Generator::stream()`)
+				procedure_ptrs[lane] = procedures[procedure];
+				procedure_ptrs[lane]->streams(streams,procedure);
+				// Reset the procedure
+				procedure_ptrs[lane]->reset(time_start,future);
+				batch->load(lane,future,streams);
+			}
 			// Iterate over years...
 			for(uint time=time_start;time<=time_calc(2035,3);time++){
-				//... set parameters on future model (e.g time varying parameters
-				// like recruitment variation but not catches)
-				parameters.set(time,future,false);
-				//... operate the procedure (having 
-				// procedure.operate() here, before future.update() allows 
-				// for the `HistCatch` procedure which simply applies historical
-				// catches
-				procedure_ptr->operate(time,future);
-				//... update the model
-				future.update(time);
-				//... track the model (for speed, only some replicates)
-				if(replicate<100 and procedure<10) tracker.get(replicate,procedure,time,future);
-				//... record performance
-				// within first 10 years
-				if (time<time_calc(2025,3)) {
-					performance.record(
-						time,
-						future,
-						procedure_ptr->control()
-					);
+				for(uint lane=0;lane<count;lane++){
+					Model& future = futures[lane];
+					//... set parameters on future model (e.g time varying parameters
+					// like recruitment variation but not catches)
+					parameters.set(time,future,false);
+					//... operate the procedure (having 
+					// procedure.operate() here, before future.update() allows 
+					// for the `HistCatch` procedure which simply applies historical
+					// catches
+					procedure_ptrs[lane]->operate(time,future);
+					batch->inputs(lane,future);
 				}
+				//... update the models
+				batch->update(time);
+				for(uint lane=0;lane<count;lane++){
+					uint procedure = first+lane;
+					Model& future = futures[lane];
+					batch->store(lane,future);
+					//... track the model (for speed, only some replicates)
+					if(replicate<100 and procedure<10) Tracker::get(tracks[lane],replicate,procedure,time,future);
+					//... record performance
+					// within first 10 years
+					if (time<time_calc(2025,3)) {
+						performances_lanes[lane].record(
+							time,
+							future,
+							procedure_ptrs[lane]->control()
+						);
+					}
+				}
+			}
+			// Save performances and tracking
+			for(uint lane=0;lane<count;lane++){
+				rep.performances.push_back(performances_lanes[lane]);
+				track<<tracks[lane].str();
 			}
-			// Save performance
-			performances.append(performance);
 		}
+		rep.track = track.str();
+	};
 
-		// Write out every 10 replicates (so results stored if aborted)
+	// Start worker threads
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::atomic<int> next(0);
+	std::vector<std::thread> workers;
+	if(threads>1){
+		for(uint thread=0;thread<threads;thread++){
+			workers.emplace_back([&](){
+				// Each worker needs its own parameters and procedures
+				// (procedures hold state during a simulation)
+				Generator.seed(seed);
+				Parameters parameters_worker = parameters;
+				Procedures procedures_worker;
+				if(procedures_read) procedures_worker.read();
+				else procedures_worker.populate();
+				int replicate;
+				while((replicate = next++)<replicates){
+					try {
+						simulate(replicate,parameters_worker,procedures_worker);
+					} catch(...) {
+						reps[replicate].error = std::current_exception();
+					}
+					std::lock_guard<std::mutex> lock(mutex);
+					reps[replicate].done = true;
+					finished.notify_all();
+				}
+			});
+		}
+	}
+
+	// For each replicate (in order)...
+	for(int replicate=0;replicate<replicates;replicate++){
+		Replicate& rep = reps[replicate];
+		//... simulate it, or wait for a worker to do so
+		if(threads>1){
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock,[&](){ return rep.done; });
+		} else {
+			simulate(replicate,parameters,procedures);
+		}
+		if(rep.error){
+			// Stop handing out replicates and wait for workers to finish
+			next = replicates;
+			for(auto& worker : workers) worker.join();
+			std::rethrow_exception(rep.error);
+		}
+		std::cout<<replicate<<std::endl;
+		//... collect outputs
+		samples.append(rep.sample);
+		references.append(rep.reference);
+		for(auto& performance : rep.performances) performances.append(performance);
+		tracker.file<<rep.track;
+		//... free memory no longer needed
+		rep.performances.clear();
+		rep.track.clear();
+
+		// Write out every 100 replicates (so results stored if aborted)
 		// or if at end
 		if(replicate%100==0 or replicate==replicates-1){
 			procedures.write("evaluate/output/procedures.tsv");
 			samples.write("evaluate/output/samples.tsv");
 			references.write("evaluate/output/references.tsv");
 			performances.write("evaluate/output/performances.tsv");
+			if(references_persist) references_cache.write("evaluate/output/references_cache.tsv");
 		}
 	}
+	for(auto& worker : workers) worker.join();
+}
+
+/**
+ * Build the store of hindcast snapshots for a samples file so that
+ * later runs of `evaluate` using those samples start from them
+ *
+ * @param samples_file A filesystem path to a TSV file of parameter samples
+ */
+void snapshots(const std::string& samples_file="feasible/output/accepted.tsv"){
+	Parameters parameters;
+	parameters.read();
+	Snapshots::build(samples_file,parameters);
+}
+
+/**
+ * Build the input bundle so that later runs of all tasks copy the parsed inputs
+ * from it rather than parsing the files in `parameters/input` and `data/input`
+ */
+void bundle(void){
+	// Remove any existing bundle so that inputs are parsed from the files
+	boost::filesystem::remove(Bundle::path());
+
+	Parameters parameters;
+	parameters.read();
+	Data data;
+	data.read();
+
+	Bundle::Writer writer;
+	writer.add(Bundle::parameters,parameters.bytes());
+	writer.add(Bundle::catches,parameters.catches.table());
+	writer.add(Bundle::m_pl_cpue,data.m_pl_cpue);
+	writer.add(Bundle::w_ps_cpue,data.w_ps_cpue);
+	writer.add(Bundle::z_ests,data.z_ests);
+	data.size_freqs_observed->write(writer);
+	writer.write();
 }
 
 void evaluate_wrap(
@@ -774,8 +2204,8 @@ void test(){
 			parameters1.set(time,model1);
 			parameters2.set(time,model2);
 			//... update the models
-			model1.update(time);
-			model2.update(time);
+			model1.update(time,0);
+			model2.update(time,0);
 			//... get data
 			data1.get(time,model1);
 			data2.get(time,model2);
@@ -803,6 +2233,17 @@ Type arg(int argc, char** argv, int which, Type default_ = Type()){
 
 int main(int argc, char** argv){ 
 	try {
+        // Extract options (e.g. `--threads 8`) leaving positional arguments in `argv`
+        int args = 1;
+        for(int index=1;index<argc;index++){
+            std::string option = argv[index];
+            if(option=="--threads" and index+1<argc) threads = std::max(boost::lexical_cast<int>(argv[++index]),1);
+            else if(option=="--seed" and index+1<argc) Generator.seed(boost::lexical_cast<uint>(argv[++index]));
+            else if(option=="--references-cache") references_persist = true;
+            else if(option=="--resume") resume = true;
+            else argv[args++] = argv[index];
+        }
+        argc = args;
         if(argc==1) throw std::runtime_error("No task given");
         std::string task = argv[1];
         std::cout<<"-------------"<<task<<"-------------\n"<<std::flush;
@@ -812,7 +2253,11 @@ int main(int argc, char** argv){
         else if(task=="priors") priors(arg<int>(argc,argv,2));
         else if(task=="condition_feasible") condition_feasible(arg<int>(argc,argv,2));
         else if(task=="condition_ss3") condition_ss3(arg<int>(argc,argv,2));
-        else if(task=="condition_demc") condition_demc(arg<int>(argc,argv,2));
+        else if(task=="condition_demc") condition_demc(arg<int>(argc,argv,2),arg<int>(argc,argv,3,1),arg<int>(argc,argv,4,10),arg<int>(argc,argv,5,600));
+        else if(task=="snapshots") snapshots(arg<std::string>(argc,argv,2,"feasible/output/accepted.tsv"));
+        else if(task=="bundle") bundle();
+        else if(task=="condition_dreamzs") condition_dreamzs(arg<int>(argc,argv,2),arg<int>(argc,argv,3,3),arg<int>(argc,argv,4,5));
+        else if(task=="condition_mpd") condition_mpd(arg<int>(argc,argv,2,1000),arg<double>(argc,argv,3,1e-3));
         else if(task=="evaluate"){
         	evaluate(
 				arg<int>(argc,argv,2,10), // int replicates=1000, 
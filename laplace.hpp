@@ -0,0 +1,114 @@
+#pragma once
+
+#include "imports.hpp"
+
+namespace IOSKJ {
+
+/**
+ * A Laplace (multivariate normal) approximation to a posterior from the Hessian
+ * of the negative log posterior at its mode
+ *
+ * The Hessian is for the `included` parameters only (e.g. those which are not within a finite
+ * difference step of a bound) and is in scaled units (parameter values divided by `scales`). It is inverted
+ * using a Cholesky decomposition. Included parameters for which the Hessian is not positive definite
+ * (i.e. which are not determined by the data and priors) are `dropped` and have undefined (NaN) covariances.
+ * Parameters which are not included have zero variance and zero covariance with all other parameters.
+ */
+class Laplace {
+public:
+
+	/**
+	 * Indices, within the Hessian, of the included parameters which are kept
+	 */
+	std::vector<uint> kept;
+
+	/**
+	 * Indices, within the Hessian, of the included parameters which are dropped
+	 * (in the order that they were dropped)
+	 */
+	std::vector<uint> dropped;
+
+	/**
+	 * Covariance matrix for all parameters (in parameter units)
+	 */
+	std::vector<std::vector<double>> covariance;
+
+	/**
+	 * Log determinant of the Hessian for the kept parameters (in parameter units)
+	 */
+	double log_determinant = 0;
+
+	/**
+	 * Calculate the approximation
+	 *
+	 * @param hessian Hessian for the included parameters (in scaled units)
+	 * @param included Index of each included parameter amongst all parameters
+	 * @param scales Scale of each of all parameters
+	 */
+	Laplace(const std::vector<std::vector<double>>& hessian, const std::vector<uint>& included, const std::vector<double>& scales){
+		uint size = included.size();
+		uint columns = scales.size();
+
+		// Cholesky decomposition, dropping parameters until it succeeds
+		for(uint row=0;row<size;row++) kept.push_back(row);
+		std::vector<std::vector<double>> cholesky;
+		while(true){
+			uint count = kept.size();
+			cholesky.assign(count,std::vector<double>(count,0));
+			int failed = -1;
+			for(uint row=0;row<count and failed<0;row++){
+				for(uint col=0;col<=row;col++){
+					double sum = hessian[kept[row]][kept[col]];
+					for(uint k=0;k<col;k++) sum -= cholesky[row][k]*cholesky[col][k];
+					if(row==col){
+						if(sum>0) cholesky[row][row] = std::sqrt(sum);
+						else failed = row;
+					}
+					else cholesky[row][col] = sum/cholesky[col][col];
+				}
+			}
+			if(failed<0) break;
+			dropped.push_back(kept[failed]);
+			kept.erase(kept.begin()+failed);
+		}
+
+		// Inverse of the Hessian for kept parameters
+		uint count = kept.size();
+		std::vector<std::vector<double>> inverse(count,std::vector<double>(count,0));
+		for(uint col=0;col<count;col++){
+			// Solve L y = e_col then L' x = y
+			std::vector<double> solution(count,0);
+			for(uint row=0;row<count;row++){
+				double sum = (row==col)?1:0;
+				for(uint k=0;k<row;k++) sum -= cholesky[row][k]*solution[k];
+				solution[row] = sum/cholesky[row][row];
+			}
+			for(int row=count-1;row>=0;row--){
+				double sum = solution[row];
+				for(uint k=row+1;k<count;k++) sum -= cholesky[k][row]*solution[k];
+				solution[row] = sum/cholesky[row][row];
+			}
+			for(uint row=0;row<count;row++) inverse[row][col] = solution[row];
+		}
+
+		// Covariance matrix: zero for parameters which are not included, undefined
+		// for those which are dropped and the inverse of the Hessian for those which are kept
+		covariance.assign(columns,std::vector<double>(columns,0));
+		for(uint row : dropped){
+			for(uint column=0;column<columns;column++){
+				covariance[included[row]][column] = covariance[column][included[row]] = NAN;
+			}
+		}
+		for(uint row=0;row<count;row++){
+			for(uint col=0;col<count;col++){
+				uint first = included[kept[row]];
+				uint second = included[kept[col]];
+				covariance[first][second] = inverse[row][col]*scales[first]*scales[second];
+			}
+		}
+
+		for(uint row=0;row<count;row++) log_determinant += 2*std::log(cholesky[row][row]/scales[included[kept[row]]]);
+	}
+};
+
+}
@@ -6,27 +6,50 @@ using namespace Utilities::Distributions;
 
 namespace IOSKJ {
 
+// Mathematical functions are called unqualified in templated code so that overloads
+// for automatic differentiation types are found by argument dependent lookup
+using std::exp;
+using std::log;
+using std::pow;
+using std::sqrt;
+using std::fabs;
+
+/**
+ * Version of the model code
+ *
+ * Model states stored by `Snapshots` and reference points cached by `References` are only
+ * reused if they were produced by the same version. So increment this whenever a change to
+ * `ModelType` (e.g. to `update()` or `equilibrium()`) alters the results it gives for the same inputs.
+ */
+const uint32_t model_version = 1;
+
 /**
  * Model of the Indian Ocean skipjack tuna fishery. This class encapsulates the dynamics
  * of both the fish population and fishing.
+ *
+ * The model is templated on the type used for its quantities so that, as well as the usual `Model`
+ * (using `double`), it can be instantiated with an automatic differentiation type to get the gradient of
+ * the likelihood (see `Parameters::set()` and `DataType`). Only the methods used for conditioning
+ * (`initialise()`, `update()` and those they call) need to compile for such types.
  */
-class Model {
+template<class Scalar = double>
+class ModelType {
 public:
 
 	/**
 	 * Fish numbers by region and age
 	 */
-	Array<double,Region,Age> numbers;
+	Array<Scalar,Region,Age> numbers;
 
 	/**
 	 * Total biomass by region
 	 */
-	Array<double,Region> biomass;
+	Array<Scalar,Region> biomass;
 
 	/**
 	 * Total biomass of spawners
 	 */
-	Array<double,Region> biomass_spawners;
+	Array<Scalar,Region> biomass_spawners;
 
 	/**
 	 * Unfished equlibrium spawners (biomass)
@@ -34,7 +57,7 @@ public:
 	 * This differs from `biomass_spawning_unfished` in that it is not affected by the proportion
 	 * spawning in a season
 	 */
-	Array<double,Region> biomass_spawners_unfished;
+	Array<Scalar,Region> biomass_spawners_unfished;
 	
 	/**
 	 * @{
@@ -44,28 +67,28 @@ public:
 	/**
 	 * The spawning fraction by quarter
 	 */
-	Array<double,Quarter> spawning;
+	Array<Scalar,Quarter> spawning;
 
 	/**
 	 * The total spawning biomass by region
 	 */
-	Array<double,Region,Quarter> biomass_spawning;
+	Array<Scalar,Region,Quarter> biomass_spawning;
 
 	/**
 	 * Unfished spawning biomass by region and quarter. It is necessary to have this by quarter
 	 * because the proportion of mature fish that spawn varies by quarter.
 	 */
-	Array<double,Region,Quarter> biomass_spawning_unfished;
+	Array<Scalar,Region,Quarter> biomass_spawning_unfished;
 
 	/**
 	 * Unfished equlibrium recruitment (numbers) by region
 	 */
-	Array<double,Region> recruits_unfished;
+	Array<Scalar,Region> recruits_unfished;
 
 	/**
 	 * Steepness of stock-recruit relation
 	 */
-	double recruits_steepness;
+	Scalar recruits_steepness;
 
 	/**
 	 * Flag to turn on/off recruitment relation
@@ -76,7 +99,7 @@ public:
 	/**
 	 * Deterministic recruitment at time t 
 	 */
-	Array<double,Region> recruits_determ;
+	Array<Scalar,Region> recruits_determ;
 
 	/**
 	 * Flag to turn on/off recruitment variation
@@ -86,7 +109,7 @@ public:
 	/**
 	 * Standard deviation of recruitment deviations
 	 */
-	double recruits_sd;
+	Scalar recruits_sd;
 
 	/**
 	 * Underlying distribution for generation recr deviations
@@ -96,22 +119,22 @@ public:
 	/**
 	 * Autocorrelation in recruitment deviations
 	 */
-	double recruits_autocorr;
+	Scalar recruits_autocorr;
 
 	/**
 	 * Recruitment deviation at time t
 	 */
-	double recruits_deviation = 0;
+	Scalar recruits_deviation = 0;
 
 	/**
 	 * Recruitment multiplier at time t
 	 */
-	double recruits_multiplier = 1;
+	Scalar recruits_multiplier = 1;
 
 	/**
 	 * Total number of recruits at time t
 	 */
-	Array<double,Region> recruits;
+	Array<Scalar,Region> recruits;
 
 
 	/**
@@ -126,14 +149,14 @@ public:
 	/**
 	 * Parameters of the two-stanza vonBertallanffy
 	 */
-	double growth_rate_1;
-	double growth_rate_2;
-	double growth_assymptote;
-	double growth_stanza_inflection;
-	double growth_stanza_steepness;
-	double growth_age_0;
-	double growth_cv_0;
-	double growth_cv_old;
+	Scalar growth_rate_1;
+	Scalar growth_rate_2;
+	Scalar growth_assymptote;
+	Scalar growth_stanza_inflection;
+	Scalar growth_stanza_steepness;
+	Scalar growth_age_0;
+	Scalar growth_cv_0;
+	Scalar growth_cv_old;
 
 	/**
 	 * Length associated with each size
@@ -148,7 +171,7 @@ public:
 	/**
 	 * Proportion of fish of each age in each size bin
 	 */
-	Array<double,Age,Size> age_size;
+	Array<Scalar,Age,Size> age_size;
 
 	/**
 	 * @}
@@ -162,14 +185,14 @@ public:
 	/**
 	 * Weight at length power funciton
 	 */
-	double weight_length_a;
-	double weight_length_b;
+	Scalar weight_length_a;
+	Scalar weight_length_b;
 
 	/**
 	 * Weight at size
 	 */
-	Array<double,Size> weight_size;
-	Array<double,Age> weight_age;
+	Array<Scalar,Size> weight_size;
+	Array<Scalar,Age> weight_age;
 
 	/**
 	 * @}
@@ -183,14 +206,14 @@ public:
 	/**
 	 * Maturity at length logistic function
 	 */
-	double maturity_length_inflection;
-	double maturity_length_steepness;
+	Scalar maturity_length_inflection;
+	Scalar maturity_length_steepness;
 
 	/**
 	 * Maturity at size and age
 	 */
-	Array<double,Size> maturity_size;
-	Array<double,Age> maturity_age;
+	Array<Scalar,Size> maturity_size;
+	Array<Scalar,Age> maturity_age;
 
 	/**
 	 * @}
@@ -205,7 +228,7 @@ public:
 	 * Mean instantaneous rate of natural mortality
 	 * across ages
 	 */
-	double mortality_mean;
+	Scalar mortality_mean;
 
 	/**
 	 * Relative morality by age. These are used to
@@ -224,12 +247,12 @@ public:
 	/**
 	 * Instantaneous rate of natural mortality at age
 	 */
-	Array<double,Age> mortality;
+	Array<Scalar,Age> mortality;
 
 	/**
 	 * Quarterly rate of survival from natural mortality at age
 	 */
-	Array<double,Age> survival;
+	Array<Scalar,Age> survival;
 
 	/**
 	 * @}
@@ -244,15 +267,15 @@ public:
 	/**
 	 * Movement maximum proportion moving from one region to another
 	 */
-	Array<double,RegionFrom,Region> movement_region;
+	Array<Scalar,RegionFrom,Region> movement_region;
 	
 	/**
 	 * Movement proportion at size logistic function
 	 */
-	double movement_length_inflection;
-	double movement_length_steepness;
-	Array<double,Size> movement_size;
-	Array<double,Age> movement_age;
+	Scalar movement_length_inflection;
+	Scalar movement_length_steepness;
+	Array<Scalar,Size> movement_size;
+	Array<Scalar,Age> movement_age;
 
 	/**
 	 * @}
@@ -271,13 +294,13 @@ public:
 	/**
 	 * Proportion selected at each selectivity knot for each method
 	 */
-	Array<double,Method,SelectivityKnot> selectivity_values;
+	Array<Scalar,Method,SelectivityKnot> selectivity_values;
 
 	/**
 	 * Selectivities by method and size
 	 */
-	Array<double,Method,Size> selectivity_size;
-	Array<double,Method,Age> selectivity_age;
+	Array<Scalar,Method,Size> selectivity_size;
+	Array<Scalar,Method,Age> selectivity_age;
 
 	/**
 	 * 
@@ -298,7 +321,7 @@ public:
 	/**
 	 * Vulnerable biomass by region and method
 	 */
-	Array<double,Region,Method> biomass_vulnerable;
+	Array<Scalar,Region,Method> biomass_vulnerable;
 
 	/**
 	 * CPUE. Simply `biomass_vulnerable` scaled to
@@ -310,7 +333,7 @@ public:
 	/**
 	 * Catches by region and method
 	 */
-	Array<double,Region,Method> catches;
+	Array<Scalar,Region,Method> catches;
 
 	/**
 	 * Effort by region and method
@@ -318,7 +341,7 @@ public:
 	 * Currently these are nominal units relative
 	 * to the period 2004-2013
 	 */
-	Array<double,Region,Method> effort;
+	Array<Scalar,Region,Method> effort;
 
 	/**
 	 * Estimated catchability by region and method
@@ -330,23 +353,23 @@ public:
 	/**
 	 * The exploitation rate specified, for example, when calculating MSY/Bmsy
 	 */
-	Array<double,Region,Method> exploitation_rate_specified;
+	Array<Scalar,Region,Method> exploitation_rate_specified;
 
 	/**
 	 * Catches by region and method given maximimum exploitation rate of
 	 * one. This variable is useful for penalising against impossible dynamics.
 	 */
-	Array<double,Region,Method> catches_taken;
+	Array<Scalar,Region,Method> catches_taken;
 
 	/**
 	 * Exploitation rate by region and method for current time step
 	 */
-	Array<double,Region,Method> exploitation_rate;
+	Array<Scalar,Region,Method> exploitation_rate;
 
 	/**
 	 * Escapement (i.e. survival form exploitation)
 	 */
-	Array<double,Region,Age> escapement;
+	Array<Scalar,Region,Age> escapement;
 
 	/**
 	 * @}
@@ -361,6 +384,16 @@ public:
 	double biomass_spawners_msy;
 	int msy_trials;
 
+	/**
+	 * Number of equilibrium solves used by the last call to `references_find()`
+	 */
+	int references_trials;
+
+	/**
+	 * Number of iterations taken by the last call to `equilibrium()`
+	 */
+	uint equilibrium_steps = 0;
+
 	/**
 	 * 40%B0 related variables
 	 */
@@ -396,7 +429,7 @@ public:
 	/**
 	 * Get the stock status (spawning biomass as a fraction of pristine)
 	 */
-	double biomass_status(void) const{
+	Scalar biomass_status(void) const{
 		return sum(biomass_spawners)/sum(biomass_spawners_unfished);
 	}
 
@@ -464,8 +497,8 @@ public:
 	/**
 	 * Get overall exploitation rate.
 	 */
-	double exploitation_rate_get(void) const {
-		double survival = geomean(escapement);
+	Scalar exploitation_rate_get(void) const {
+		Scalar survival = geomean(escapement);
 		return 1 - survival;
 	}
 
@@ -481,16 +514,19 @@ public:
 	 * Get overall instantaneous rate of fishing mortality (F).
 	 * Like `exploitation_rate_get` but gives F instead of exp. rate.
 	 */
-	double fishing_mortality_get(void) const {
-		return -std::log(1-exploitation_rate_get());
+	Scalar fishing_mortality_get(void) const {
+		return -log(1-exploitation_rate_get());
 	}
 
 	/**
 	 * Set the catch by region/method assuming a 
 	 * certain allocation, currently based on the 
 	 * period 2003-2012 (see `data/nominal-catches-quarter.R`)
+	 *
+	 * Implementation errors are drawn from `stream` (e.g. the
+	 * procedure's stream for the time, see `Procedure::stream()`)
 	 */
-	void catches_set(double catches_, double error=0.2){
+	void catches_set(double catches_, Philox stream, double error=0.2){
 		// Turn on exploitation defined by `catches`
 		exploit = exploit_catch;
 
@@ -501,21 +537,21 @@ public:
 		 */
 		
 		Lognormal dist(1,error);
-                
-		catches(WE,PS) = 0.354 * catches_ * dist.random();
-		catches(WE,PL) = 0.018 * catches_ * dist.random();
-		catches(WE,GN) = 0.117 * catches_ * dist.random();
-		catches(WE,OT) = 0.024 * catches_ * dist.random();
-
-		catches(MA,PS) = 0.000 * catches_ * dist.random();
-		catches(MA,PL) = 0.198 * catches_ * dist.random();
-		catches(MA,GN) = 0.000 * catches_ * dist.random();
-		catches(MA,OT) = 0.005 * catches_ * dist.random();
-
-		catches(EA,PS) = 0.058 * catches_ * dist.random();
-		catches(EA,PL) = 0.006 * catches_ * dist.random();
-		catches(EA,GN) = 0.141 * catches_ * dist.random();
-		catches(EA,OT) = 0.078 * catches_ * dist.random();
+
+		catches(WE,PS) = 0.354 * catches_ * dist.random(stream);
+		catches(WE,PL) = 0.018 * catches_ * dist.random(stream);
+		catches(WE,GN) = 0.117 * catches_ * dist.random(stream);
+		catches(WE,OT) = 0.024 * catches_ * dist.random(stream);
+
+		catches(MA,PS) = 0.000 * catches_ * dist.random(stream);
+		catches(MA,PL) = 0.198 * catches_ * dist.random(stream);
+		catches(MA,GN) = 0.000 * catches_ * dist.random(stream);
+		catches(MA,OT) = 0.005 * catches_ * dist.random(stream);
+
+		catches(EA,PS) = 0.058 * catches_ * dist.random(stream);
+		catches(EA,PL) = 0.006 * catches_ * dist.random(stream);
+		catches(EA,GN) = 0.141 * catches_ * dist.random(stream);
+		catches(EA,OT) = 0.078 * catches_ * dist.random(stream);
 	}
 
 	/**
@@ -533,112 +569,148 @@ public:
 
 	//! @}
 
+	/**
+	 * Stages of `initialise()` which can be skipped if the attributes
+	 * they depend upon have not changed since the model was last initialised
+	 */
+	enum {
+		// Length distributions by age
+		initialise_growth = 1,
+		// Weight, maturity and movement by size
+		initialise_sizes = 2,
+		// Selectivity by size
+		initialise_selectivity = 4,
+		// Mortality and survival by age
+		initialise_mortality = 8,
+		// Regional movement (only affects the pristine state)
+		initialise_movement = 16,
+		// Pristine state (e.g. for changes in spawning or unfished biomass)
+		initialise_pristine = 32,
+
+		initialise_all = 63
+	};
+
 	/**
 	 * Initialise various model variables based on current parameter values
+	 *
+	 * @param stages The stages to perform. When this is not `initialise_all` the variables
+	 * calculated by the other stages (including the pristine state) must already have been initialised
+	 * (e.g. by copying a model initialised with the same values for the attributes they depend upon). 
+	 * Regional movement is always normalised since it is bound directly to parameters.
 	 */
-	void initialise(void){
+	void initialise(uint stages = initialise_all){
 		// Initialise length distributions by age
-		double growth_cv_slope = (growth_cv_old - growth_cv_0)/ages.size();
-		for(auto age : ages){
-			// Convert age from quarters (middle of quarter) to years
-			double a = double(age.index()+0.5)/4.0;
-			// Mean length at age
-			double part1 = (1+std::exp(-growth_stanza_steepness*(a-growth_age_0-growth_stanza_inflection)))/
-						   (1+std::exp(growth_stanza_inflection*growth_stanza_steepness));
-			double part2 = std::pow(part1,-(growth_rate_2-growth_rate_1)/growth_stanza_steepness);
-			double mean = growth_assymptote * (1-std::exp(-growth_rate_2*(a-growth_age_0))*part2);
-			// Standard deviation of length at age
-			double cv = growth_cv_0 + growth_cv_slope*a;
-			double sd = mean * cv;
-			Normal dist(mean,sd);
-			length_age(age) = dist;
-			// Calculate proportions in each size bin
-			double sum = 0;
-			for(auto size : sizes){
-				double lower = 2*size.index();
-				double upper = lower+2;
-				double prop = dist.cdf(upper)-dist.cdf(lower);
-				age_size(age,size) = prop;
-				sum += prop;
+		if(stages & initialise_growth){
+			Scalar growth_cv_slope = (growth_cv_old - growth_cv_0)/ages.size();
+			for(auto age : ages){
+				// Convert age from quarters (middle of quarter) to years
+				double a = double(age.index()+0.5)/4.0;
+				// Mean length at age
+				Scalar part1 = (1+exp(-growth_stanza_steepness*(a-growth_age_0-growth_stanza_inflection)))/
+							   (1+exp(growth_stanza_inflection*growth_stanza_steepness));
+				Scalar part2 = pow(part1,-(growth_rate_2-growth_rate_1)/growth_stanza_steepness);
+				Scalar mean = growth_assymptote * (1-exp(-growth_rate_2*(a-growth_age_0))*part2);
+				// Standard deviation of length at age
+				Scalar cv = growth_cv_0 + growth_cv_slope*a;
+				Scalar sd = mean * cv;
+				length_age(age) = Normal(scalar_value(mean),scalar_value(sd));
+				// Calculate proportions in each size bin
+				Scalar sum = 0;
+				for(auto size : sizes){
+					double lower = 2*size.index();
+					double upper = lower+2;
+					Scalar prop = normal_cdf(upper,mean,sd)-normal_cdf(lower,mean,sd);
+					age_size(age,size) = prop;
+					sum += prop;
+				}
+				// Normalise to ensure rows sum to 1
+				for(auto size : sizes) age_size(age,size) /= sum;
 			}
-			// Normalise to ensure rows sum to 1
-			for(auto size : sizes) age_size(age,size) /= sum;
 		}
 
 		// Initialise arrays that are dimensioned by size	
-		for(auto size : sizes){
-			double length = 2*size.index()+1;
-			length_size(size) = length;
-			weight_size(size) = weight_length_a*std::pow(length,weight_length_b);
-			maturity_size(size) = 1.0/(1.0+std::pow(19,(maturity_length_inflection-length)/maturity_length_steepness));
-			movement_size(size) = 1.0/(1.0+std::pow(19,(movement_length_inflection-length)/movement_length_steepness));
+		if(stages & initialise_sizes){
+			for(auto size : sizes){
+				double length = 2*size.index()+1;
+				length_size(size) = length;
+				weight_size(size) = weight_length_a*pow(length,weight_length_b);
+				maturity_size(size) = 1.0/(1.0+pow(19,(maturity_length_inflection-length)/maturity_length_steepness));
+				movement_size(size) = 1.0/(1.0+pow(19,(movement_length_inflection-length)/movement_length_steepness));
+			}
 		}
 
 		// Initialise selectivity
-		for(auto method : methods){
-			// Iterpolate selectivity-at-size using piecewise spline
-			// Ensure that selectivity is between 0 and 1 since spline
-			// can produce values outside this range even if knots are not
-			double max = 0;
-			for(auto size : sizes){
-				double length = length_size(size);
-				double selectivity = 0;
-				if(length<selectivity_lengths(0)) selectivity = 0;
-				else{
-					for(uint knot=0;knot<selectivity_knots.size()-1;knot++){
-						if(selectivity_lengths(knot)<=length and length<selectivity_lengths(knot+1)){
-							selectivity = selectivity_values(method,knot) + (length-selectivity_lengths(knot)) * (
-								selectivity_values(method,knot+1)-selectivity_values(method,knot))/(
-								selectivity_lengths(knot+1)-selectivity_lengths(knot)
-							);
+		if(stages & initialise_selectivity){
+			for(auto method : methods){
+				// Iterpolate selectivity-at-size using piecewise spline
+				// Ensure that selectivity is between 0 and 1 since spline
+				// can produce values outside this range even if knots are not
+				Scalar max = 0;
+				for(auto size : sizes){
+					double length = length_size(size);
+					Scalar selectivity = 0;
+					if(length<selectivity_lengths(0)) selectivity = 0;
+					else{
+						for(uint knot=0;knot<selectivity_knots.size()-1;knot++){
+							if(selectivity_lengths(knot)<=length and length<selectivity_lengths(knot+1)){
+								selectivity = selectivity_values(method,knot) + (length-selectivity_lengths(knot)) * (
+									selectivity_values(method,knot+1)-selectivity_values(method,knot))/(
+									selectivity_lengths(knot+1)-selectivity_lengths(knot)
+								);
+							}
 						}
 					}
+					if(selectivity<0) selectivity = 0;
+					else if(selectivity>max) max = selectivity;
+					selectivity_size(method,size) = selectivity;
 				}
-				if(selectivity<0) selectivity = 0;
-				else if(selectivity>max) max = selectivity;
-				selectivity_size(method,size) = selectivity;
+				for(auto size : sizes) selectivity_size(method,size) /= max;
 			}
-			for(auto size : sizes) selectivity_size(method,size) /= max;
 		}
 		
 		// Initialise arrays that are dimensioned by age but dependent
 		// up arrays dimensioned by size
-		weight_age = 0;
-		maturity_age = 0;
-		selectivity_age = 0;
-		for(auto age : ages){
-			for(auto size : sizes){
-				weight_age(age) += weight_size(size) * age_size(age,size);
-				maturity_age(age) += maturity_size(size) * age_size(age,size);
-				movement_age(age) += movement_size(size) * age_size(age,size);
-				for(auto method : methods) selectivity_age(method,age) += selectivity_size(method,size) * age_size(age,size);
+		if(stages & (initialise_growth|initialise_sizes|initialise_selectivity)){
+			weight_age = 0;
+			maturity_age = 0;
+			movement_age = 0;
+			selectivity_age = 0;
+			for(auto age : ages){
+				for(auto size : sizes){
+					weight_age(age) += weight_size(size) * age_size(age,size);
+					maturity_age(age) += maturity_size(size) * age_size(age,size);
+					movement_age(age) += movement_size(size) * age_size(age,size);
+					for(auto method : methods) selectivity_age(method,age) += selectivity_size(method,size) * age_size(age,size);
+				}
 			}
-		}
 
-		// Normalise movement and selectivities to maximum
-		double movement_max = -1;
-		Array<double,Method> selectivity_max = -1;
-		for(auto age : ages){
-			if(movement_age(age)>movement_max) movement_max = movement_age(age);
-			for(auto method : methods){
-				if(selectivity_age(method,age)>selectivity_max(method)) selectivity_max(method) = selectivity_age(method,age);
+			// Normalise movement and selectivities to maximum
+			Scalar movement_max = -1;
+			Array<Scalar,Method> selectivity_max = -1;
+			for(auto age : ages){
+				if(movement_age(age)>movement_max) movement_max = movement_age(age);
+				for(auto method : methods){
+					if(selectivity_age(method,age)>selectivity_max(method)) selectivity_max(method) = selectivity_age(method,age);
+				}
+			}
+			for(auto age : ages){
+				movement_age(age) /= movement_max;
+				for(auto method : methods) selectivity_age(method,age) /= selectivity_max(method);
 			}
-		}
-		for(auto age : ages){
-			movement_age(age) /= movement_max;
-			for(auto method : methods) selectivity_age(method,age) /= selectivity_max(method);
 		}
 
 		// Set up mortality by age schedule
-		for(auto age : ages){
-			mortality(age) = mortality_mean * mortality_shape(age);
-			survival(age) = std::exp(-0.25 * mortality(age));
+		if(stages & initialise_mortality){
+			for(auto age : ages){
+				mortality(age) = mortality_mean * mortality_shape(age);
+				survival(age) = exp(-0.25 * mortality(age));
+			}
 		}
 
 		// Initialise regional movement matrix
 		for(auto region_from : region_froms){
 			// Check that the off diagonal elements sum to between 0 and 1
-			double off_diagonals = 0;
+			Scalar off_diagonals = 0;
 			for(auto region : regions){
 				if(region_from.index()!=region.index()) off_diagonals += movement_region(region_from,region);
 			}
@@ -657,7 +729,7 @@ public:
 		}
 
 		// Initialise normal distribution for recr. devs.
-		recruits_distrib = Normal(0,recruits_sd);
+		recruits_distrib = Normal(0,scalar_value(recruits_sd));
 
 		// During debug mode dump the model here for easy inspection
 		// Done here before equilibrium() in case that fails
@@ -665,8 +737,8 @@ public:
 			write();
 		#endif
 
-		// Go to pristine
-		pristine_go();
+		// Go to pristine (selectivity does not affect the pristine state)
+		if(stages & ~initialise_selectivity) pristine_go();
 
 		// During debug mode dump the model here for easy inspection
 		// Done after equilibrium() and biomass_spawning_unfished has been set
@@ -677,41 +749,67 @@ public:
 
 	/**
 	 * Perform a single time step
-	 */
-	void update(uint time){
+	 *
+	 * Dispatches to a version of `update_()` specialised for the current
+	 * exploitation mode
+	 *
+	 * @param replicate Replicate whose random number streams are used for recruitment
+	 *                  variation (see `Generator::stream()`)
+	 */
+	void update(uint time, uint32_t replicate){
+		switch(exploit){
+			case exploit_none: update_<exploit_none>(time,replicate); break;
+			case exploit_rate: update_<exploit_rate>(time,replicate); break;
+			case exploit_catch: update_<exploit_catch>(time,replicate); break;
+			case exploit_effort: update_<exploit_effort>(time,replicate); break;
+		}
+	}
+
+	/**
+	 * Perform a single time step for a particular exploitation mode
+	 *
+	 * The steps (biomass, recruitment, ageing, natural mortality, movement, fishing mortality)
+	 * are fused into as few passes over `numbers` as possible. Each element of `numbers` still 
+	 * undergoes the same operations in the same order as when the steps are done one after
+	 * the other (ages are independent of each other during movement and summations are done
+	 * in the same order) so results are not altered by the fusion.
+	 */
+	template<int Exploit>
+	void update_(uint time, uint32_t replicate){
 		uint year = IOSKJ::year(time);
 		uint quarter = IOSKJ::quarter(time);
-
-		// Calculate total biomass, spawners biomass and spawning biomass by region
-		for(auto region : regions){
-			double biomass_ = 0;
-			double biomass_spawners_ = 0;
-			double biomass_spawning_ = 0;
-			for(auto age : ages){
-				double biomass = numbers(region,age) * weight_age(age)/1000;
+		const uint ages_last = ages.size()-1;
+
+		// Random number stream for recruitment variation at this time
+		Philox recruits_stream = Generator.stream(replicate,0,time,purpose_recruitment);
+
+		// For each region, a single pass over ages to calculate total biomass, spawners 
+		// biomass and spawning biomass, then recruitment, then a single pass
+		// over ages for ageing and natural mortality
+		for(uint region=0;region<regions_size;region++){
+			Scalar biomass_ = 0;
+			Scalar biomass_spawners_ = 0;
+			Scalar biomass_spawning_ = 0;
+			for(uint age=0;age<ages_size;age++){
+				Scalar biomass = numbers(region,age) * weight_age(age)/1000;
 				biomass_ += biomass;
-				double spawners = biomass * maturity_age(age);
+				Scalar spawners = biomass * maturity_age(age);
 				biomass_spawners_ += spawners;
 				biomass_spawning_ += spawners * spawning(quarter);
 			}
 			biomass(region) = biomass_;
 			biomass_spawners(region) = biomass_spawners_;
 			biomass_spawning(region,quarter) = biomass_spawning_;
-		} 
-
-		// Ageing and recruitment
-		for(auto region : regions){
 
 			// Recruits
 			// Determininistic recruitment given stock size
 			if(recruits_relation_on){
 				// Stock-recruitment relation is active so calculate recruits based on 
 				// the spawning biomass in the previous time step
-				double h = recruits_steepness;
-				double r0 = recruits_unfished(region);
-				double s0 = biomass_spawning_unfished(region,quarter);
-				double s = biomass_spawning(region,quarter);
-				recruits_determ(region) =  4*h*r0*s/((5*h-1)*s+s0*(1-h));
+				recruits_determ(region) = recruits_relation(
+					recruits_steepness,recruits_unfished(region),
+					biomass_spawning_unfished(region,quarter),biomass_spawning_
+				);
 			} else {
 				// Stock-recruitment relation is not active so recruitment is just r0.
 				recruits_determ(region) = recruits_unfished(region);
@@ -720,99 +818,71 @@ public:
 			// Important: recruitment deviation is set only once per year
 			// otherwise, if set quarterly, will be less than specified
 			if(recruits_variation_on and quarter==0){
-		        recruits_deviation = recruits_autocorr*recruits_deviation + 
-		        					 std::sqrt(1-std::pow(recruits_autocorr,2))*recruits_distrib.random();
-		        recruits_multiplier = std::exp(recruits_deviation - 0.5*std::pow(recruits_sd,2));
+				recruits_vary(
+					recruits_deviation,recruits_multiplier,
+					recruits_autocorr,recruits_sd,recruits_distrib,recruits_stream
+				);
 			}
 			recruits(region) = recruits_determ(region) * recruits_multiplier;
 
-			// Oldest age class accumulates 
-			numbers(region,ages.size()-1) += numbers(region,ages.size()-2);
-
-			// For most ages just "shuffle" along
-			for(uint age=ages.size()-2;age>0;age--){
+			// Oldest age class accumulates, for most ages just "shuffle" along and
+			// recruits from a region become age 0 in the region. Then apply
+			// natural mortality.
+			numbers(region,ages_last) += numbers(region,ages_last-1);
+			numbers(region,ages_last) *= survival(ages_last);
+			for(uint age=ages_last-1;age>0;age--){
 				numbers(region,age) = numbers(region,age-1);
-			}
-
-			// Recruits from a regeion become age 0 in the region
-			numbers(region,0) = recruits(region);
-		}
-
-		// Natural mortality
-		for(auto region : regions){
-			for(auto age : ages){
 				numbers(region,age) *= survival(age);
 			}
+			numbers(region,0) = recruits(region);
+			numbers(region,0) *= survival(0);
 		}
 
-		// Movement
-		for(auto region_from : region_froms){
-			for(auto region_to : regions){
-				for(auto age : ages){
-					double movers = 
-						numbers(Level<Region>(region_from),age) * 
+		// For each age, a single pass over regions for movement and, if exploited,
+		// accumulation of vulnerable biomass
+		if(Exploit!=exploit_none) biomass_vulnerable = 0;
+		for(uint age=0;age<ages_size;age++){
+			// Movement
+			for(uint region_from=0;region_from<regions_size;region_from++){
+				for(uint region_to=0;region_to<regions_size;region_to++){
+					Scalar movers = 
+						numbers(region_from,age) * 
 						movement_region(region_from,region_to) * 
 						movement_age(age);
-					numbers(Level<Region>(region_from),age) -= movers;
+					numbers(region_from,age) -= movers;
 					numbers(region_to,age) += movers;
 				}
 			}
+			// Vulnerable biomass
+			if(Exploit!=exploit_none){
+				for(uint region=0;region<regions_size;region++){
+					for(uint method=0;method<methods_size;method++){
+						biomass_vulnerable(region,method) += numbers(region,age) * 
+							                                 weight_age(age)/1000 * 
+							                                 selectivity_age(method,age);
+					}
+				}
+			}
 		}
 
 		// Fishing mortality
-		if(exploit!=exploit_none){
-			// For each region and method
-			for(auto region : regions){
-				for(auto method : methods){
-					// Calculate vulnerable biomass
-					double biomass_vuln = 0;
-					for(auto age : ages){
-						biomass_vuln += numbers(region,age) * 
-						                weight_age(age)/1000 * 
-							            selectivity_age(method,age);
-					}
-					biomass_vulnerable(region,method) = biomass_vuln;
-
-					// Update CPUE
-					if(quarter==0){
-						if(year==1985) cpue_base(region,method).reset();
-						// User 1985-1989 as the 'base' years. This allows for
-						// retrospective operation of CPUE based management procedure
-						// from 1990 onwards
-						if(year>=1985 and year<=1989){
-							cpue_base(region,method).append(biomass_vuln);
-						} else {
-							cpue(region,method) = biomass_vuln/cpue_base(region,method);
-						}
-					}
+		if(Exploit!=exploit_none){
+			// Determine exploitation rate for each region and method
+			for(uint region=0;region<regions_size;region++){
+				for(uint method=0;method<methods_size;method++){
+					Scalar biomass_vuln = biomass_vulnerable(region,method);
+
+					// Update CPUE (only in the first quarter)
+					if(quarter==0) cpue_update(year,region,method);
 
-					// Determine exploitation rate
-					double er = 0;
-					if(exploit==exploit_catch){
+					Scalar er = 0;
+					if(Exploit==exploit_catch){
 						// Calculate exploitation rate from catches and biomass_vulnerable
-						double c = catches(region,method);
-						if(c>0){
-							if(biomass_vuln>0){
-								er = c/biomass_vuln;
-								if(er>1) er = 1;
-							} else er = 1;
-						} else er = 0;
-						// Update estimate of catchability
-						double e = effort(region,method);
-						if(e>0){
-							double q = er/e;
-							if(year==2005) catchability_estim(region,method).reset();
-							if(q>0 and year>=2005 and year<=2014) catchability_estim(region,method).append(q);
-							if(year==2014){
-								catchability(region,method) = catchability_estim(region,method);
-								// Where no catches for a region method make catchability 0
-								if(not std::isfinite(catchability(region,method))){
-									catchability(region,method) = 0;
-								}
-							}
-						}
+						er = exploitation_rate_catch(catches(region,method),biomass_vuln);
+						// Update estimate of catchability (only during the estimation period)
+						if(year>=2005 and year<=2014 and effort(region,method)>0) catchability_update(year,region,method,er);
 					}
-					else if(exploit==exploit_effort){
+					else if(Exploit==exploit_effort){
 						// Calculate exploitation rate from number of
 						// effort units
 						er = catchability(region,method) * effort(region,method);
@@ -824,33 +894,133 @@ public:
 					catches_taken(region,method) = er * biomass_vuln;
 				}
 			}
-			// Pre-calculate the escapement for each region and ages
-			for(auto region : regions){
-				for(auto age : ages){
-					double proportion_taken = 0;
-					for(auto method : methods){
+			// Calculate the escapement for each region and age
+			// and apply it in the same pass
+			for(uint region=0;region<regions_size;region++){
+				for(uint age=0;age<ages_size;age++){
+					Scalar proportion_taken = 0;
+					for(uint method=0;method<methods_size;method++){
 						proportion_taken += exploitation_rate(region,method) * selectivity_age(method,age);
 					}
-					escapement(region,age) = (proportion_taken>1)?0:(1-proportion_taken);
+					Scalar escapement_ = (proportion_taken>1)?Scalar(0):(1-proportion_taken);
+					escapement(region,age) = escapement_;
+					numbers(region,age) *= escapement_;
 				}
 			}
 		} 
 		else {
+			// No fishing so escapement is one and numbers are unchanged
 			escapement = 1;
 		}
-		// Apply escapement
-		for(auto region : regions){
-			for(auto age : ages){
-				numbers(region,age) *= escapement(region,age);
+	}
+
+	/**
+	 * Update CPUE for a region and method
+	 */
+	void cpue_update(uint year, uint region, uint method){
+		cpue_step(year,cpue_base(region,method),cpue(region,method),scalar_value(biomass_vulnerable(region,method)));
+	}
+
+	/**
+	 * Update the estimate of catchability for a region and method
+	 */
+	void catchability_update(uint year, uint region, uint method, Scalar er){
+		catchability_step(
+			year,catchability_estim(region,method),catchability(region,method),
+			scalar_value(er)/scalar_value(effort(region,method))
+		);
+	}
+
+	/**
+	 * @{
+	 * @name Steps of `update()` for a single partition
+	 *
+	 * Also used by `ModelBatch::update()` for each of its lanes so
+	 * that both do exactly the same operations.
+	 */
+
+	/**
+	 * Deterministic recruitment from the Beverton-Holt stock-recruitment relation
+	 * given steepness, unfished recruitment, unfished spawning biomass and spawning biomass
+	 */
+	static Scalar recruits_relation(Scalar h, Scalar r0, Scalar s0, Scalar s){
+		return 4*h*r0*s/((5*h-1)*s+s0*(1-h));
+	}
+
+	/**
+	 * Draw the next (autocorrelated) recruitment deviation from a stream and
+	 * calculate the corresponding recruitment multiplier
+	 */
+	static void recruits_vary(Scalar& deviation, Scalar& multiplier, Scalar autocorr, Scalar sd, Normal& distrib, Philox& stream){
+		deviation = autocorr*deviation + sqrt(1-pow(autocorr,2))*distrib.random(stream);
+		multiplier = exp(deviation - 0.5*pow(sd,2));
+	}
+
+	/**
+	 * Exploitation rate needed to take a catch from a vulnerable biomass (at most one)
+	 */
+	static Scalar exploitation_rate_catch(Scalar c, Scalar biomass_vuln){
+		if(c>0){
+			if(biomass_vuln>0){
+				Scalar er = c/biomass_vuln;
+				if(er>1) er = 1;
+				return er;
+			} else return 1;
+		} else return 0;
+	}
+
+	/**
+	 * Update CPUE (in the first quarter of a year) given vulnerable biomass
+	 */
+	static void cpue_step(uint year, GeometricMean& base, double& cpue, double biomass_vuln){
+		if(year==1985) base.reset();
+		// User 1985-1989 as the 'base' years. This allows for
+		// retrospective operation of CPUE based management procedure
+		// from 1990 onwards
+		if(year>=1985 and year<=1989){
+			base.append(biomass_vuln);
+		} else {
+			cpue = biomass_vuln/base;
+		}
+	}
+
+	/**
+	 * Update the estimate of catchability given the catchability (`q`) implied by the exploitation rate
+	 * and effort during the estimation period (2005-2014)
+	 */
+	static void catchability_step(uint year, GeometricMean& estim, double& catchability, double q){
+		if(year==2005) estim.reset();
+		if(q>0) estim.append(q);
+		if(year==2014){
+			catchability = estim;
+			// Where no catches for a region method make catchability 0
+			if(not std::isfinite(catchability)){
+				catchability = 0;
 			}
 		}
 	}
 
+	//! @}
+
 	/**
-	 * Move the population to a deterministic equilibrium by iterating over
-	 * time until biomass in each region remains stable
+	 * Move the population to a deterministic equilibrium
+	 *
+	 * Each iteration applies four quarterly updates (so that quarterly differences in dynamics, 
+	 * e.g. spawning proportion, are incorporated) which is treated as a fixed point map `G` of
+	 * `numbers`. Convergence is accelerated using Anderson mixing: the next iterate is the combination
+	 * of the last `depth` map values which minimises the (linearised) residual `G(x)-x`. If that
+	 * combination is not valid (e.g. negative numbers) the plain map value is used instead.
+	 * Iteration stops when the mean relative change in biomass by region over an iteration is
+	 * less than `tolerance`. The number of iterations is recorded in `equilibrium_steps`.
+	 *
+	 * The tolerance is tight enough that biomass and catches from a warm start (which makes the result depend 
+	 * on the previous call) agree with those from a cold start to about ten significant digits (numbers in 
+	 * partitions with little biomass agree less closely; see the `equilibrium_warm` test).
+	 *
+	 * @param warm Start from the current state (e.g. a previous equilibrium with a similar
+	 *             exploitation rate) rather than a small population in each partition
 	 */
-	void equilibrium(void){
+	void equilibrium(bool warm = false){
 		#if DEBUG
 			std::cout<<"************equilibrium()**************\n";
 		#endif
@@ -859,47 +1029,249 @@ public:
 		bool recruits_variation_on_setting = recruits_variation_on;
 		recruits_variation_on = false;
 		// Seed the population with a small population in each partition
-		numbers = 1;	
-		// Iterate until there is a very minor change in biomass
+		// unless warm starting from a state with more biomass than that (a collapsed state
+		// is a poor starting point since recovery from it is slow)
+		if(warm){
+			double biomass_seed = 0;
+			double biomass_current = 0;
+			for(uint age=0;age<ages_size;age++){
+				for(uint region=0;region<regions_size;region++){
+					biomass_seed += weight_age(age)/1000;
+					biomass_current += numbers(region,age) * weight_age(age)/1000;
+				}
+			}
+			if(not (biomass_current>biomass_seed and std::isfinite(biomass_current))) warm = false;
+		}
+		if(not warm) numbers = 1;
+
+		const uint size = regions_size*ages_size;
+		const uint depth = 5;
+		const double tolerance = 1e-10;
+		// Current iterate, map value and residual and their previous values
+		double x[size], g[size], f[size], g_prev[size], f_prev[size];
+		// Differences in map values and residuals over the last `depth` iterations held
+		// in a circular buffer (`next` is the slot to be overwritten, `m` the number in use)
+		double dgs[depth][size], dfs[depth][size];
+		uint next = 0;
+		uint m = 0;
+		// Regional biomass of an iterate
+		auto biomass_of = [&](const double* n, uint region){
+			double biomass = 0;
+			for(uint age=0;age<ages_size;age++) biomass += n[region*ages_size+age] * weight_age(age)/1000;
+			return biomass;
+		};
+		for(uint region=0;region<regions_size;region++){
+			for(uint age=0;age<ages_size;age++) x[region*ages_size+age] = numbers(region,age);
+		}
 		uint steps = 0;
 		const uint steps_max = 1000;
-		Array<double,Region> biomass_prev = 1;
 		while(steps<steps_max){
-			// It is necessary to update the model for each quarter so that quarterly differences
-			// in dynamics (e.g. spawning proportion) are incorporated
-			for(uint quarter=0;quarter<4;quarter++) update(quarter);
+			// Recruitment variation is off so no random number streams are used
+			for(uint quarter=0;quarter<4;quarter++) update(quarter,0);
 
 			// Break if biomass has gone to very low levels (as happens when this method
 			// is called with high exploitation rates from yield_curve) since the proportional
 			// diffs minimise to a low level
 			if(biomass(sum)<0.01) break;
 
+			// Throw an error if undefined biomass
+			if(not std::isfinite(biomass(WE)+biomass(MA)+biomass(EA))){
+				write();
+				throw std::runtime_error("Biomass is not finite. Check inputs. Model has been written to `model/output`");
+			}
+
+			for(uint region=0;region<regions_size;region++){
+				for(uint age=0;age<ages_size;age++) g[region*ages_size+age] = numbers(region,age);
+			}
+			for(uint i=0;i<size;i++) f[i] = g[i]-x[i];
+
 			double diffs = 0;
-			for(auto region : regions){
-				diffs += fabs(biomass(region)-biomass_prev(region))/biomass_prev(region);
+			for(uint region=0;region<regions_size;region++){
+				double biomass_x = biomass_of(x,region);
+				diffs += std::fabs(biomass_of(g,region)-biomass_x)/biomass_x;
 			}
-			diffs /= regions.size();
-			if(diffs<0.0001) break;
-			biomass_prev = biomass;
+			diffs /= regions_size;
 
 			#if DEBUG
 				std::cout<<steps<<"\t"<<biomass(WE)<<"\t"<<biomass(MA)<<"\t"<<biomass(EA)<<"\t"<<diffs<<std::endl;
 			#endif
 
-			// Throw an error if undefined biomass
-			if(not std::isfinite(biomass(WE)+biomass(MA)+biomass(EA))){
-				write();
-				throw std::runtime_error("Biomass is not finite. Check inputs. Model has been written to `model/output`");
-			}
-
 			steps++;
+			if(diffs<tolerance) break;
+
+			// Update history of differences
+			if(steps>1){
+				for(uint i=0;i<size;i++){
+					dgs[next][i] = g[i]-g_prev[i];
+					dfs[next][i] = f[i]-f_prev[i];
+				}
+				next = (next+1)%depth;
+				if(m<depth) m++;
+			}
+			std::copy(g,g+size,g_prev);
+			std::copy(f,f+size,f_prev);
+
+			// Next iterate is the map value...
+			std::copy(g,g+size,x);
+			//... with Anderson mixing
+			if(m>0){
+				// Solve the least squares problem min |f - dF gamma| using 
+				// the (slightly regularised) normal equations and Gaussian elimination
+				double a[depth][depth+1] = {};
+				double trace = 0;
+				for(uint j=0;j<m;j++){
+					for(uint k=0;k<m;k++){
+						for(uint i=0;i<size;i++) a[j][k] += dfs[j][i]*dfs[k][i];
+					}
+					for(uint i=0;i<size;i++) a[j][m] += dfs[j][i]*f[i];
+					trace += a[j][j];
+				}
+				for(uint j=0;j<m;j++) a[j][j] += 1e-12*trace/m;
+				bool valid = true;
+				for(uint pivot=0;pivot<m and valid;pivot++){
+					uint best = pivot;
+					for(uint row=pivot+1;row<m;row++){
+						if(std::fabs(a[row][pivot])>std::fabs(a[best][pivot])) best = row;
+					}
+					std::swap(a[pivot],a[best]);
+					if(not(std::fabs(a[pivot][pivot])>0)) valid = false;
+					else {
+						for(uint row=pivot+1;row<m;row++){
+							double factor = a[row][pivot]/a[pivot][pivot];
+							for(uint col=pivot;col<=m;col++) a[row][col] -= factor*a[pivot][col];
+						}
+					}
+				}
+				if(valid){
+					double gamma[depth];
+					for(uint row=m;row-->0;){
+						double value = a[row][m];
+						for(uint col=row+1;col<m;col++) value -= a[row][col]*gamma[col];
+						gamma[row] = value/a[row][row];
+					}
+					for(uint i=0;i<size and valid;i++){
+						for(uint j=0;j<m;j++) x[i] -= dgs[j][i]*gamma[j];
+						if(not(x[i]>=0) or not std::isfinite(x[i])) valid = false;
+					}
+				}
+				// If the mixed iterate is not valid then use the map value
+				// and restart the history
+				if(not valid){
+					std::copy(g,g+size,x);
+					next = 0;
+					m = 0;
+				}
+			}
+			for(uint region=0;region<regions_size;region++){
+				for(uint age=0;age<ages_size;age++) numbers(region,age) = x[region*ages_size+age];
+			}
 		}
-		// Throw an error if there was no convergence
-		if(steps>steps_max) throw std::runtime_error("No convergence in equilibrium() function");
+		equilibrium_steps = steps;
 		// Turn on recruitment deviation again
 		recruits_variation_on = recruits_variation_on_setting;
 	}
 
+	/**
+	 * Move the population directly to the unfished equilibrium
+	 *
+	 * With constant recruitment and no exploitation, each time step is a linear operation on
+	 * `numbers` which is the same in every quarter. So, rather than iterating over time as in `equilibrium()`,
+	 * the fixed point can be calculated age by age: the survivors of the previous age are moved
+	 * among regions by the 3x3 movement for the age (applied in the same order as in `update()`). 
+	 * For the plus group, the survivors remaining in the group each time step form a geometric series 
+	 * which is summed by solving `(I-B)x = Bn` where `B` is survival times movement and `n` 
+	 * is the numbers in the second oldest age.
+	 *
+	 * Assumes that `recruits_relation_on` and `exploit` have been turned off (as in `pristine_go()`)
+	 */
+	void equilibrium_unfished(void){
+		// Movement of numbers at an age among regions, in the same order as in `update()`
+		auto move = [&](Scalar* n, uint age){
+			for(uint region_from=0;region_from<regions_size;region_from++){
+				for(uint region_to=0;region_to<regions_size;region_to++){
+					Scalar movers = n[region_from] * movement_region(region_from,region_to) * movement_age(age);
+					n[region_from] -= movers;
+					n[region_to] += movers;
+				}
+			}
+		};
+
+		// Recruits (recruitment variation is not applied)
+		Scalar n[regions_size];
+		for(uint region=0;region<regions_size;region++){
+			recruits_determ(region) = recruits_unfished(region);
+			recruits(region) = recruits_determ(region) * recruits_multiplier;
+			n[region] = recruits(region);
+		}
+		// Ages up to the plus group
+		const uint ages_last = ages_size-1;
+		for(uint age=0;age<ages_last;age++){
+			for(uint region=0;region<regions_size;region++) n[region] *= survival(age);
+			move(n,age);
+			for(uint region=0;region<regions_size;region++) numbers(region,age) = n[region];
+		}
+		// Plus group
+		// Matrix B: survival then movement applied to each unit vector
+		Scalar b[regions_size][regions_size];
+		for(uint col=0;col<regions_size;col++){
+			Scalar unit[regions_size] = {};
+			unit[col] = survival(ages_last);
+			move(unit,ages_last);
+			for(uint row=0;row<regions_size;row++) b[row][col] = unit[row];
+		}
+		// Right hand side, Bn, and left hand side, I-B 
+		Scalar x[regions_size];
+		Scalar lhs[regions_size][regions_size];
+		for(uint row=0;row<regions_size;row++){
+			x[row] = 0;
+			for(uint col=0;col<regions_size;col++){
+				x[row] += b[row][col] * n[col];
+				lhs[row][col] = (row==col?1:0) - b[row][col];
+			}
+		}
+		// Solve using Gaussian elimination. Movement conserves numbers and survival is less 
+		// than one so I-B is column diagonally dominant and pivoting is not required.
+		for(uint pivot=0;pivot<regions_size;pivot++){
+			for(uint row=pivot+1;row<regions_size;row++){
+				Scalar factor = lhs[row][pivot]/lhs[pivot][pivot];
+				for(uint col=pivot;col<regions_size;col++) lhs[row][col] -= factor * lhs[pivot][col];
+				x[row] -= factor * x[pivot];
+			}
+		}
+		for(uint row=regions_size;row-->0;){
+			for(uint col=row+1;col<regions_size;col++) x[row] -= lhs[row][col] * x[col];
+			x[row] /= lhs[row][row];
+		}
+		for(uint region=0;region<regions_size;region++) numbers(region,ages_last) = x[region];
+
+		// Biomasses at equilibrium (the same in all quarters apart from spawning)
+		for(uint region=0;region<regions_size;region++){
+			Scalar biomass_ = 0;
+			Scalar biomass_spawners_ = 0;
+			for(uint age=0;age<ages_size;age++){
+				Scalar biomass = numbers(region,age) * weight_age(age)/1000;
+				biomass_ += biomass;
+				biomass_spawners_ += biomass * maturity_age(age);
+			}
+			biomass(region) = biomass_;
+			biomass_spawners(region) = biomass_spawners_;
+			for(uint quarter=0;quarter<quarters_size;quarter++){
+				biomass_spawning(region,quarter) = biomass_spawners_ * spawning(quarter);
+			}
+		}
+		escapement = 1;
+
+		// Throw an error if undefined biomass
+		if(not std::isfinite(scalar_value(biomass(WE)+biomass(MA)+biomass(EA)))){
+			write();
+			throw std::runtime_error("Biomass is not finite. Check inputs. Model has been written to `model/output`");
+		}
+	}
+
+	/**
+	 * Move the population to the unfished state and scale unfished recruitment
+	 * to match `biomass_spawners_unfished`
+	 */
 	void pristine_go(void){
 		// Calculate unfished state
 		// Turn off recruitment relationship and exploitation
@@ -909,12 +1281,12 @@ public:
 		// so it can be calculated in terms of biomass_spawners_unfished
 		recruits_unfished = 1e10;
 		// Go to equilibrium
-		equilibrium();
+		equilibrium_unfished();
 		// Scale up unfished recruitment and biomass_spawning_unfished (by region and quarter) 
 		// to match biomass_spawners_unfished
 		for(auto region : regions){
 			// Calculate scalar
-			double scalar = biomass_spawners_unfished(region)/biomass_spawners(region);
+			Scalar scalar = biomass_spawners_unfished(region)/biomass_spawners(region);
 			// Apply scalar
 			recruits_unfished(region) *= scalar;
 			for(auto age : ages) numbers(region,age) *= scalar;
@@ -943,7 +1315,7 @@ public:
 				std::cout<<"************yield_curve "<<exprate<<"**************\n";
 			#endif
 			exploitation_rate_set(std::max(exprate,1e-6));
-			equilibrium();
+			equilibrium(true);
 			curve.append({
 				exprate,fishing_mortality_get(),sum(catches_taken),biomass_status(),sum(biomass_vulnerable),
 				catches_taken(WE,PS),catches_taken(MA,PL),catches_taken(EA,GN),
@@ -987,7 +1359,7 @@ public:
 		auto result = boost::math::tools::brent_find_minima([&](double exprate){
 			count++;
 			exploitation_rate_set(exprate);
-			equilibrium();
+			equilibrium(true);
 			return -sum(catches_taken);
 		},0.01,0.99,8);
 		e_msy = result.first;
@@ -996,7 +1368,7 @@ public:
 		msy_trials = count;
 		// Go to equilibrium with maximum so that Bmsy can be determined
 		exploitation_rate_set(e_msy);
-		equilibrium();
+		equilibrium(true);
 		biomass_spawners_msy = sum(biomass_spawners);
 	}
 
@@ -1005,7 +1377,7 @@ public:
 	 */
 	void msy_find(void){
 		// Create a copy of this model and take it to MSY
-		Model calc = *this;
+		ModelType calc = *this;
 		calc.msy_go();
 		// Copy over values
 		e_msy = calc.e_msy;
@@ -1024,14 +1396,14 @@ public:
 		auto result = boost::math::tools::brent_find_minima([&](double exprate){
 			count++;
 			exploitation_rate_set(exprate);
-			equilibrium();
+			equilibrium(true);
 			return std::fabs(biomass_status()-status);
 		},0.01,0.99,8);
 		e_40 = result.first;
 		f_40 = -std::log(1-e_40);
 		// Go to equilibrium with maximum so that Bmsy can be determined
 		exploitation_rate_set(e_40);
-		equilibrium();
+		equilibrium(true);
 		biomass_spawners_40 = sum(biomass_spawners);
 	}
 
@@ -1041,7 +1413,7 @@ public:
 	void b40_find(void){
 		// Create a copy of this model and take it
 		// to MSY
-		Model calc = *this;
+		ModelType calc = *this;
 		calc.status_go(0.4);
 		// Copy over values
 		e_40 = calc.e_40;
@@ -1049,6 +1421,153 @@ public:
 		biomass_spawners_40 = calc.biomass_spawners_40;
 	}
 
+	/**
+	 * Hash of the model attributes which determine equilibrium states, and 
+	 * so reference points (see `references_find()`), and of `model_version`
+	 *
+	 * Uses the FNV-1a hash of the bytes of each value
+	 */
+	uint64_t equilibrium_hash(void) const {
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](double value){
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+			for(uint byte=0;byte<sizeof(value);byte++){
+				hash ^= bytes[byte];
+				hash *= 1099511628211ull;
+			}
+		};
+		for(auto value : weight_age) add(value);
+		for(auto value : maturity_age) add(value);
+		for(auto value : survival) add(value);
+		for(auto value : movement_age) add(value);
+		for(auto value : movement_region) add(value);
+		for(auto value : selectivity_age) add(value);
+		for(auto value : spawning) add(value);
+		for(auto value : recruits_unfished) add(value);
+		for(auto value : biomass_spawning_unfished) add(value);
+		for(auto value : biomass_spawners_unfished) add(value);
+		add(recruits_steepness);
+		add(recruits_relation_on);
+		add(model_version);
+		return hash;
+	}
+
+	/**
+	 * Calculate MSY and B40 related reference points together
+	 *
+	 * `msy_find()` and `b40_find()` search over the same curve of equilibrium states. Here, 
+	 * equilibrium states (yield, status and spawners biomass) are cached by exploitation rate
+	 * so that they are shared by both searches. MSY is found using the same Brent search as in 
+	 * `msy_go()`. Then, since status decreases with exploitation rate, E40 is bracketed by the cached
+	 * states (and the unfished state) and found by interpolation, usually needing only one or two more
+	 * equilibrium solves. Reference points are taken from the cached states so no final equilibrium
+	 * solves are required.
+	 *
+	 * The number of equilibrium solves is recorded in `references_trials`.
+	 */
+	void references_find(void){
+		// Create a copy of this model to take to equilibria. Start from the unfished state
+		// with average recruitment so that reference points depend only on the attributes
+		// in `equilibrium_hash()` and not on the current state.
+		ModelType calc = *this;
+		calc.recruits_multiplier = 1;
+		calc.equilibrium_unfished();
+		// Equilibrium states by exploitation rate
+		struct State {
+			double yield;
+			double status;
+			double spawners;
+		};
+		std::map<double,State> states;
+		auto state = [&](double exprate) -> const State& {
+			auto iter = states.find(exprate);
+			if(iter!=states.end()) return iter->second;
+			calc.exploitation_rate_set(exprate);
+			// Warm start from the previous equilibrium
+			calc.equilibrium(true);
+			return states[exprate] = {
+				sum(calc.catches_taken),
+				calc.biomass_status(),
+				sum(calc.biomass_spawners)
+			};
+		};
+		const double exprate_min = 0.01;
+		const double exprate_max = 0.99;
+
+		// MSY
+		auto result = boost::math::tools::brent_find_minima([&](double exprate){
+			return -state(exprate).yield;
+		},exprate_min,exprate_max,8);
+		e_msy = result.first;
+		f_msy = -std::log(1-e_msy);
+		msy = -result.second;
+		msy_trials = states.size();
+		biomass_spawners_msy = state(e_msy).spawners;
+
+		// E40
+		// Equilibrium status is close to `1/(1+cF)` so the search is done on the transformed
+		// variables F (fishing mortality) and `1/status - 1/0.4` which are nearly proportional.
+		// The unexploited state is included as a point. Its status is one so no solve is needed.
+		const double status = 0.4;
+		auto point = [&](double exprate){
+			double f = -std::log(1-exprate);
+			double g = (exprate==0)?1:state(exprate).status;
+			return std::make_pair(f,1/g-1/status);
+		};
+		// Bracket using the cached states (status decreases with exploitation rate)
+		double lower = 0;
+		double upper = -1;
+		for(const auto& item : states){
+			if(item.second.status>=status) lower = item.first;
+			else if(upper<0) upper = item.first;
+		}
+		if(upper<0) upper = exprate_max;
+		double best;
+		// Target status is not reached with no exploitation...
+		if(point(lower).second>=0) best = lower;
+		//... or even with maximum exploitation rate
+		else if(point(upper).second<=0) best = upper;
+		else {
+			// Inverse quadratic interpolation through the three points nearest the target status 
+			// (or linear interpolation across the bracket if that falls outside it), stopping when
+			// status is within 0.002 of the target (about twice as close as `status_go()`).
+			std::vector<double> exprates = {0};
+			for(const auto& item : states) exprates.push_back(item.first);
+			for(uint iteration=0;iteration<50;iteration++){
+				std::sort(exprates.begin(),exprates.end(),[&](double a, double b){
+					return std::fabs(point(a).second)<std::fabs(point(b).second);
+				});
+				best = exprates[0];
+				if(std::fabs(1/(point(best).second+1/status)-status)<2e-3 or upper-lower<1e-4) break;
+				auto a = point(lower);
+				auto b = point(upper);
+				double f = (a.first*b.second-b.first*a.second)/(b.second-a.second);
+				if(exprates.size()>=3){
+					auto p0 = point(exprates[0]);
+					auto p1 = point(exprates[1]);
+					auto p2 = point(exprates[2]);
+					double q = 
+						p0.first*p1.second*p2.second/((p0.second-p1.second)*(p0.second-p2.second)) +
+						p1.first*p0.second*p2.second/((p1.second-p0.second)*(p1.second-p2.second)) +
+						p2.first*p0.second*p1.second/((p2.second-p0.second)*(p2.second-p1.second));
+					if(std::isfinite(q) and q>a.first and q<b.first) f = q;
+				}
+				// Bisect if interpolation fails (e.g. for a collapsed stock at the upper end)
+				if(not(f>a.first and f<b.first)) f = (a.first+b.first)/2;
+				double exprate = 1-std::exp(-f);
+				if(point(exprate).second<=0) lower = exprate;
+				else upper = exprate;
+				exprates.push_back(exprate);
+			}
+		}
+		if(best<exprate_min) best = exprate_min;
+		e_40 = best;
+		f_40 = -std::log(1-e_40);
+		biomass_spawners_40 = state(e_40).spawners;
+
+		references_trials = states.size();
+	}
+
 	/**
 	 * Write model attributes to files for examination
 	 */
@@ -1084,4 +1603,6 @@ public:
 
 };
 
+typedef ModelType<> Model;
+
 }
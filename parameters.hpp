@@ -2,6 +2,8 @@
 
 #include "model.hpp"
 #include "variable.hpp"
+#include "bundle.hpp"
+#include "catches.hpp"
 
 namespace IOSKJ {
 
@@ -51,6 +53,12 @@ public:
 			if(steepness<0.6) return -INFINITY;
 			else return std::log(Beta::pdf(steepness*1.25-0.25));
 		}
+		template<class Scalar>
+		Scalar loglike(const Scalar& steepness) const {
+			if(steepness<0.6) return -INFINITY;
+			Scalar x = steepness*1.25-0.25;
+			return (alpha-1)*log(x) + (beta-1)*log(1-x) - (std::lgamma(alpha)+std::lgamma(beta)-std::lgamma(alpha+beta));
+		}
 	};
 	Variable<SteepnessBeta> recruits_steepness;
 
@@ -125,9 +133,10 @@ public:
 	Array<Variable<Uniform>,Method,SelectivityKnot> selectivities;
 
 	/**
-	 * Catches by year, quarter, region and method
+	 * Catches by year, quarter, region and method (shared by all copies
+	 * and, because they are fixed, not reflected)
 	 */
-	Array<Variable<Fixed>,Year,Quarter,Region,Method> catches;
+	CatchHistory catches;
 
     /**
      * Reflection
@@ -174,23 +183,83 @@ public:
             .data(movement_length_steepness,"movement_length_steepness")
 
             .data(selectivities,"selectivities")
-
-            .data(catches,"catches")
         ;
     }
 
     using Structure<Parameters>::read;
 
+    /**
+     * Read parameters from the input bundle if it is up to date (see `Bundle`),
+     * otherwise from the files in `parameters/input`
+     */
     void read(void){
+    	std::vector<char> bytes;
+    	if(Bundle::opened().get(Bundle::parameters,bytes) and this->bytes(bytes)) return;
+
     	Structure<Parameters>::read("parameters/input/parameters.json");
     	
     	recruits_deviations.read("parameters/input/recruits_deviations.tsv",true);
     	selectivities.read("parameters/input/selectivities.tsv",true);
+    }
+
+    /**
+     * Rows of a frame of parameter samples (e.g. `feasible/output/accepted.tsv`) bound to parameters
+     *
+     * Reading a row using `Structure::read(const Frame&)` matches the label of every column to a parameter.
+     * Here, that is done once, for all rows, when they are bound. The values of the bound columns are held
+     * in a row-major matrix so that reading a row into parameters is just a copy of each value to the offset,
+     * within `Parameters`, of its variable's value. Columns which are not parameter values are ignored.
+     */
+    class Rows {
+    public:
+
+    	explicit Rows(const Frame& samples){
+    		Parameters parameters;
+    		auto addresses = Addresser().mirror(parameters).addresses;
+    		std::vector<uint> columns;
+    		for(uint column=0;column<samples.columns();column++){
+    			auto iter = addresses.find(samples.label(column));
+    			if(iter!=addresses.end()){
+    				columns.push_back(column);
+    				offsets_.push_back(
+    					reinterpret_cast<const char*>(iter->second)-reinterpret_cast<const char*>(&parameters)
+    				);
+    			}
+    		}
+    		rows_ = samples.rows();
+    		values_.resize(rows_*columns.size());
+    		for(uint row=0;row<rows_;row++){
+    			for(uint index=0;index<columns.size();index++){
+    				values_[row*columns.size()+index] = samples.value(row,columns[index]);
+    			}
+    		}
+    	}
+
+    	uint rows(void) const {
+    		return rows_;
+    	}
+
+    	void read(uint row, Parameters& parameters) const {
+    		if(row>=rows_) throw std::runtime_error("Sample row out of range: "+std::to_string(row));
+    		const double* values = &values_[row*offsets_.size()];
+    		char* start = reinterpret_cast<char*>(&parameters);
+    		for(uint index=0;index<offsets_.size();index++){
+    			*reinterpret_cast<double*>(start+offsets_[index]) = values[index];
+    		}
+    	}
+
+    private:
+    	std::vector<std::ptrdiff_t> offsets_;
+    	std::vector<double> values_;
+    	uint rows_ = 0;
+    };
 
-    	catches.read("parameters/input/catches.tsv",true);
-		catches.each([](Variable<Fixed>& catche){
-			if(catche.is_na()) catche = 0;
-		});
+    /**
+     * Read parameters from a row of bound samples
+     */
+    Parameters& read(const Rows& rows, uint row){
+    	rows.read(row,*this);
+    	return *this;
     }
 
     using Structure<Parameters>::write;
@@ -200,17 +269,247 @@ public:
 
     	recruits_deviations.write("parameters/output/recruits_deviations.tsv",true);
     	selectivities.write("parameters/output/selectivities.tsv",true);
-    	catches.write("parameters/output/catches.tsv",true);
+    	catches.write("parameters/output/catches.tsv");
 
     	values().write("parameters/output/values.tsv");
     }
 
+	/**
+	 * Get the raw bytes of each of the reflected parameters (for the input bundle)
+	 */
+	std::vector<char> bytes(void){
+		return BytesGetter().mirror(*this).bytes;
+	}
+	struct BytesGetter : Mirrors::Mirror<BytesGetter> {
+		std::vector<char> bytes;
+
+		template<class Type>
+		BytesGetter& data(Type& field, const std::string& name){
+			static_assert(
+				std::is_trivially_copyable<Type>::value,
+				"Parameters are stored in the bundle as raw bytes so must be trivially copyable"
+			);
+			const char* start = reinterpret_cast<const char*>(&field);
+			bytes.insert(bytes.end(),start,start+sizeof(Type));
+			return *this;
+		}
+	};
+
+	/**
+	 * Set each of the reflected parameters from raw bytes
+	 *
+	 * @returns `false` (leaving parameters unchanged) if the bytes are not the size of the reflected parameters
+	 */
+	bool bytes(const std::vector<char>& bytes){
+		if(bytes.size()!=this->bytes().size()) return false;
+		BytesSetter(bytes).mirror(*this);
+		return true;
+	}
+	struct BytesSetter : Mirrors::Mirror<BytesSetter> {
+		const std::vector<char>& bytes;
+		std::size_t offset = 0;
+
+		BytesSetter(const std::vector<char>& bytes):
+			bytes(bytes){}
+
+		template<class Type>
+		BytesSetter& data(Type& field, const std::string& name){
+			std::memcpy(static_cast<void*>(&field),&bytes[offset],sizeof(Type));
+			offset += sizeof(Type);
+			return *this;
+		}
+	};
+
 	/**
 	 * Set model variables
 	 *
 	 * @parameters catches_apply Turn off application of catches (e.g. in hindcasts of procedures)
 	 */
 	void set(uint time, Model& model, bool catches_apply = true) const {
+		set_(time,model,catches_apply,Value());
+	}
+
+	/**
+	 * A model as it was after the last call to `set()` for time zero, and the values of the
+	 * time-invariant parameters used to initialise it
+	 */
+	struct Initialised {
+		Model model;
+		std::vector<double> values;
+	};
+
+	/**
+	 * Set model variables, only repeating the stages of `Model::initialise()`
+	 * which depend upon time-invariant parameters that have changed since the last initialisation
+	 *
+	 * When conditioning, most proposals only change a few parameters, many of which (e.g. recruitment deviations)
+	 * do not affect the initialisation of the model. At time zero, the model is copied from `initialised` and
+	 * only the stages affected by changed parameters are repeated. Results are identical to those of `set()` for
+	 * a newly constructed model.
+	 */
+	void set(uint time, Model& model, Initialised& initialised, bool catches_apply = true) const {
+		if(time==0){
+			auto invariants = this->invariants();
+			uint stages = 0;
+			if(initialised.values.size()!=invariants.size()) stages = Model::initialise_all;
+			else {
+				for(uint index=0;index<invariants.size();index++){
+					double previous = initialised.values[index];
+					double current = invariants[index].first;
+					if(not (current==previous or (std::isnan(current) and std::isnan(previous)))) stages |= invariants[index].second;
+				}
+				model = initialised.model;
+			}
+			set_(time,model,catches_apply,Value(),stages);
+			initialised.model = model;
+			initialised.values.resize(invariants.size());
+			for(uint index=0;index<invariants.size();index++) initialised.values[index] = invariants[index].first;
+		}
+		else set_(time,model,catches_apply,Value());
+	}
+
+	/**
+	 * Get the values of time-invariant parameters and the stages of
+	 * `Model::initialise()` which they affect
+	 */
+	std::vector<std::pair<double,uint>> invariants(void) const {
+		const uint pristine = Model::initialise_pristine;
+		const uint growth = Model::initialise_growth;
+		const uint sizes = Model::initialise_sizes;
+		std::vector<std::pair<double,uint>> invariants = {
+			{spawners_unfished,pristine},
+			{spawners_ma,pristine},
+			{spawners_ea,pristine},
+			// Recruitment parameters do not affect any of the stages (`recruits_distrib`
+			// is always initialised) but are included so that all parameters bound at time zero are listed
+			{recruits_steepness,0},
+			{recruits_sd,0},
+			{recruits_autocorr,0},
+			{spawning_0,pristine},
+			{spawning_1,pristine},
+			{spawning_2,pristine},
+			{spawning_3,pristine},
+			{weight_a,sizes},
+			{weight_b,sizes},
+			{maturity_inflection,sizes},
+			{maturity_steepness,sizes},
+			{mortality_mean,Model::initialise_mortality},
+			{growth_rate_1,growth},
+			{growth_rate_2,growth},
+			{growth_assymptote,growth},
+			{growth_stanza_inflection,growth},
+			{growth_stanza_steepness,growth},
+			{growth_age_0,growth},
+			{growth_cv_0,growth},
+			{growth_cv_old,growth},
+			{movement_we_ma,Model::initialise_movement},
+			{movement_we_ea,Model::initialise_movement},
+			{movement_ma_ea,Model::initialise_movement},
+			{movement_length_inflection,sizes},
+			{movement_length_steepness,sizes}
+		};
+		for(const auto& selectivity : selectivities) invariants.push_back({selectivity,Model::initialise_selectivity});
+		return invariants;
+	}
+
+	/**
+	 * Set the variables of a model templated on an automatic differentiation type
+	 * using values (e.g. independent variables) for each of the parameters which
+	 * are not fixed (in the same order as `vector()`)
+	 *
+	 * Fixed parameters (e.g. catches) are set from their values.
+	 */
+	template<class Scalar>
+	void set(uint time, ModelType<Scalar>& model, const std::vector<Scalar>& values, bool catches_apply = true) const {
+		set_(time,model,catches_apply,ScalarValue<Scalar>(*this,values));
+	}
+
+	/**
+	 * Calculate prior likelihoods for parameters, templated on an automatic differentiation type,
+	 * using values for each of the parameters which are not fixed (in the same order as `vector()`)
+	 */
+	template<class Scalar>
+	Scalar loglike(const std::vector<Scalar>& values) const {
+		ScalarLogliker<Scalar> logliker(values);
+		logliker.mirror(const_cast<Parameters&>(*this));
+		return logliker.loglike;
+	}
+
+private:
+
+	/**
+	 * Get the value of a parameter
+	 */
+	struct Value {
+		template<class Distribution>
+		double operator()(const Variable<Distribution>& variable) const {
+			return variable.value;
+		}
+	};
+
+	/**
+	 * Get the value of a parameter from a vector of values 
+	 * of an automatic differentiation type
+	 */
+	template<class Scalar>
+	struct ScalarValue {
+		const Parameters& parameters;
+		const std::vector<Scalar>& values;
+
+		ScalarValue(const Parameters& parameters, const std::vector<Scalar>& values):
+			parameters(parameters),
+			values(values){
+			if(values.size()!=vector_size()) throw std::runtime_error("Wrong number of parameter values: "+std::to_string(values.size()));
+		}
+
+		template<class Distribution>
+		Scalar operator()(const Variable<Distribution>& variable) const {
+			int index = parameters.index_(variable);
+			if(index<0) return variable.value;
+			else return values[index];
+		}
+	};
+
+	/**
+	 * Offsets, within `Parameters`, of the values in `vector()`. The layout is the same
+	 * for all instances so it is only determined once.
+	 */
+	static const std::vector<std::ptrdiff_t>& offsets_(void){
+		static const std::vector<std::ptrdiff_t> offsets = [](){
+			Parameters parameters;
+			return Offsetter(parameters).mirror(parameters).offsets;
+		}();
+		return offsets;
+	}
+
+	/**
+	 * Index in `vector()` of the double at each position within `Parameters` (-1 if it is not the value
+	 * of a variable). Derived from `offsets_()` once so that variables are looked up without mirroring.
+	 */
+	static const std::vector<int>& indices_(void){
+		static const std::vector<int> indices = [](){
+			std::vector<int> indices(sizeof(Parameters)/sizeof(double),-1);
+			const auto& offsets = offsets_();
+			for(uint index=0;index<offsets.size();index++) indices[offsets[index]/sizeof(double)] = index;
+			return indices;
+		}();
+		return indices;
+	}
+
+	/**
+	 * Get the index in `vector()` of a variable of this instance (-1 if it is fixed)
+	 */
+	template<class Distribution>
+	int index_(const Variable<Distribution>& variable) const {
+		std::ptrdiff_t offset = reinterpret_cast<const char*>(&variable.value)-reinterpret_cast<const char*>(this);
+		return indices_()[offset/sizeof(double)];
+	}
+
+	/**
+	 * Set model variables using a functor to get the value of each parameter
+	 */
+	template<class Scalar, class Getter>
+	void set_(uint time, ModelType<Scalar>& model, bool catches_apply, const Getter& get, uint stages = ModelType<Scalar>::initialise_all) const {
 		uint year = IOSKJ::year(time);
 		uint quarter = IOSKJ::quarter(time);
 		
@@ -218,66 +517,69 @@ public:
 		if(time==0){
 			// Stock - recruitment
 			// Apportion `spawners_unfished` to regions
-			Array<double,Region> props = {
-				double(1.0),
-				double(spawners_ma),
-				double(spawners_ea)
+			Array<Scalar,Region> props = {
+				Scalar(1.0),
+				get(spawners_ma),
+				get(spawners_ea)
 			};
-			props /= sum(props);
-			for(auto region : regions) model.biomass_spawners_unfished(region) = spawners_unfished * props(region);
+			Scalar props_sum = 0;
+			for(auto region : regions) props_sum += props(region);
+			for(auto region : regions) model.biomass_spawners_unfished(region) = get(spawners_unfished) * (props(region)/props_sum);
 
-			model.recruits_steepness = recruits_steepness;
-			model.recruits_sd = recruits_sd;
+			model.recruits_steepness = get(recruits_steepness);
+			model.recruits_sd = get(recruits_sd);
+			model.recruits_autocorr = get(recruits_autocorr);
 
 			// Proportion of mature fish spawning in each quarter
-			model.spawning(0) = spawning_0;
-			model.spawning(1) = spawning_1;
-			model.spawning(2) = spawning_2;
-			model.spawning(3) = spawning_3;
+			model.spawning(0) = get(spawning_0);
+			model.spawning(1) = get(spawning_1);
+			model.spawning(2) = get(spawning_2);
+			model.spawning(3) = get(spawning_3);
 
 			// Length-weight relationship
-			model.weight_length_a = weight_a;
-			model.weight_length_b = weight_b;
+			model.weight_length_a = get(weight_a);
+			model.weight_length_b = get(weight_b);
 
 			// Maturity curve
-			model.maturity_length_inflection = maturity_inflection;
-			model.maturity_length_steepness = maturity_steepness;
+			model.maturity_length_inflection = get(maturity_inflection);
+			model.maturity_length_steepness = get(maturity_steepness);
 
 			// Mortality-at-age curve
-			model.mortality_mean = mortality_mean;
+			model.mortality_mean = get(mortality_mean);
 			
 			// Growth curve
-			model.growth_rate_1 = growth_rate_1;
-			model.growth_rate_2 = growth_rate_2;
-			model.growth_assymptote = growth_assymptote;
-			model.growth_stanza_inflection = growth_stanza_inflection;
-			model.growth_stanza_steepness = growth_stanza_steepness;
-			model.growth_cv_0 = growth_cv_0;
-			model.growth_cv_old = growth_cv_old;
+			model.growth_rate_1 = get(growth_rate_1);
+			model.growth_rate_2 = get(growth_rate_2);
+			model.growth_assymptote = get(growth_assymptote);
+			model.growth_stanza_inflection = get(growth_stanza_inflection);
+			model.growth_stanza_steepness = get(growth_stanza_steepness);
+			model.growth_age_0 = get(growth_age_0);
+			model.growth_cv_0 = get(growth_cv_0);
+			model.growth_cv_old = get(growth_cv_old);
 
 			// Movement
 			// Note that in the model.intialise function these
 			// proportional are restricted so that they do not sum to greater
 			// than one.
-			model.movement_region(WE,WE) = 1-movement_we_ma-movement_we_ea;
-			model.movement_region(WE,MA) = movement_we_ma;
-			model.movement_region(WE,EA) = movement_we_ea;
+			model.movement_region(WE,WE) = 1-get(movement_we_ma)-get(movement_we_ea);
+			model.movement_region(WE,MA) = get(movement_we_ma);
+			model.movement_region(WE,EA) = get(movement_we_ea);
 
-			model.movement_region(MA,WE) = movement_we_ma;
-			model.movement_region(MA,MA) = 1-movement_we_ma-movement_ma_ea;
-			model.movement_region(MA,EA) = movement_ma_ea;
+			model.movement_region(MA,WE) = get(movement_we_ma);
+			model.movement_region(MA,MA) = 1-get(movement_we_ma)-get(movement_ma_ea);
+			model.movement_region(MA,EA) = get(movement_ma_ea);
 
-			model.movement_region(EA,WE) = movement_we_ea;
-			model.movement_region(EA,MA) = movement_ma_ea;
-			model.movement_region(EA,EA) = 1-movement_ma_ea-movement_we_ea;
+			model.movement_region(EA,WE) = get(movement_we_ea);
+			model.movement_region(EA,MA) = get(movement_ma_ea);
+			model.movement_region(EA,EA) = 1-get(movement_ma_ea)-get(movement_we_ea);
 
-			model.movement_length_inflection = movement_length_inflection;
-			model.movement_length_steepness = movement_length_steepness;
+			model.movement_length_inflection = get(movement_length_inflection);
+			model.movement_length_steepness = get(movement_length_steepness);
 
 			// Selectivity
 			for(auto method : methods){
 				for(auto knot : selectivity_knots){
-					model.selectivity_values(method,knot) = selectivities(method,knot);
+					model.selectivity_values(method,knot) = get(selectivities(method,knot));
 				}
 			}
 		}
@@ -291,7 +593,7 @@ public:
 		else if(year>=recdev_years.begin() and year<recdev_years.end()){
 			// Stochastic recruitment defined by recruitment deviation parameters
 			model.recruits_variation_on = false;
-			model.recruits_multiplier = std::exp(recruits_deviations(year));
+			model.recruits_multiplier = exp(get(recruits_deviations(year)));
 		}
 		#if 0
 		// Currently this is turned off as it only applies
@@ -312,15 +614,9 @@ public:
 		// Bind quarterly catch history to the model's catches
 		if(catches_apply and year>=1950 and year<=2014){
 			model.exploit = model.exploit_catch;
-			for(auto region : regions){
-				for(auto method : methods){
-					model.catches(region,method) = catches(
-						year,
-						quarter,
-						region,
-						method
-					);
-				}
+			const double* catches_quarter = catches.quarter(year,quarter);
+			for(uint index=0;index<regions_size*methods_size;index++){
+				model.catches[index] = catches_quarter[index];
 			}
 		}
 
@@ -330,9 +626,11 @@ public:
 		if(year>=2005 and year<=2014) model.effort = 100;
 
 		// Initialise in the first year
-		if(time==0) model.initialise();
+		if(time==0) model.initialise(stages);
 	}
 
+public:
+
 	/**
 	 * A base Mirror class used for mirroring only variables that are not fixed
 	 */
@@ -471,42 +769,146 @@ public:
 		}
 	};
 
+	/**
+	 * Get the number of variables that are not fixed (i.e. the length of `vector()`)
+	 */
+	static uint vector_size(void){
+		return offsets_().size();
+	}
+
+	/**
+	 * Get the values of variables that are not fixed into `vector_size()` contiguous values
+	 */
+	void vector_get(double* values) const {
+		const char* start = reinterpret_cast<const char*>(this);
+		const auto& offsets = offsets_();
+		for(uint index=0;index<offsets.size();index++){
+			values[index] = *reinterpret_cast<const double*>(start+offsets[index]);
+		}
+	}
+
+	/**
+	 * Set the values of variables that are not fixed from `vector_size()` contiguous values
+	 */
+	void vector_set(const double* values){
+		char* start = reinterpret_cast<char*>(this);
+		const auto& offsets = offsets_();
+		for(uint index=0;index<offsets.size();index++){
+			*reinterpret_cast<double*>(start+offsets[index]) = values[index];
+		}
+	}
+
 	/**
 	 * Get the values of variables as a vector
 	 */
-	std::vector<double> vector(void){
-		return VectorGetter().mirror(*this).values;
+	std::vector<double> vector(void) const {
+		std::vector<double> values(vector_size());
+		vector_get(values.data());
+		return values;
+	}
+
+	/**
+	 * Set the values of variables from a vector
+	 */
+	void vector(const std::vector<double>& vector){
+		if(vector.size()!=vector_size()) throw std::runtime_error("Wrong number of parameter values: "+std::to_string(vector.size()));
+		vector_set(vector.data());
+	}
+
+	/**
+	 * Get the first year in which each variable (in the same order as `vector()`) is
+	 * used by `set()`: the year of recruitment deviations and zero for all other (time-invariant) parameters
+	 */
+	std::vector<uint> years(void){
+		std::vector<uint> years(vector_size(),0);
+		for(uint year=recdev_years.begin();year<recdev_years.end();year++){
+			int index = index_(recruits_deviations(year));
+			if(index>=0) years[index] = year;
+		}
+		return years;
+	}
+
+	/**
+	 * Get the minimum or maximum values of variables (in the same order as `vector()`)
+	 */
+	std::vector<double> minimums(void){
+		return Limiter(false).mirror(*this).values;
+	}
+	std::vector<double> maximums(void){
+		return Limiter(true).mirror(*this).values;
 	}
-	struct VectorGetter : Variabler<VectorGetter> {
-		using Variabler<VectorGetter>::data;
+	struct Limiter : Variabler<Limiter> {
+		using Variabler<Limiter>::data;
 		std::vector<double> values;
+		bool maximum;
+
+		Limiter(bool maximum):
+			maximum(maximum){}
 
 		template<class Distribution>
-		VectorGetter& data(Variable<Distribution>& variable, const std::string& name){
-			values.push_back(variable.value);
+		Limiter& data(Variable<Distribution>& variable, const std::string& name){
+			values.push_back(maximum?variable.maximum():variable.minimum());
 			return *this;
 		}
 	};
 
 	/**
-	 * Set the values of variables from a vector
+	 * Get the address of the value of each variable (including fixed variables),
+	 * by the label of its column in a frame of values
 	 */
-	void vector(const std::vector<double>& vector){
-		VectorSetter(vector).mirror(*this);
-	}
-	struct VectorSetter : Variabler<VectorSetter> {
-		using Variabler<VectorSetter>::data;
-		std::vector<double> values;
-		int index;
+	struct Addresser : Mirrors::Mirror<Addresser> {
+		std::map<std::string,double*> addresses;
+		std::string prefix;
 
-		VectorSetter(const std::vector<double>& vector){
-			values = vector;
-			index = 0;
+		template<class Distribution, class... Dimensions>
+		Addresser& data(Array<Variable<Distribution>,Dimensions...>& array, const std::string& name){
+			prefix = name;
+			array.reflect(*this);
+			prefix = "";
+			return *this;
 		}
 
 		template<class Distribution>
-		VectorSetter& data(Variable<Distribution>& variable, const std::string& name){
-			variable.value = values[index];
+		Addresser& data(Variable<Distribution>& variable, const std::string& name){
+			addresses[prefix+name+".value"] = &variable.value;
+			return *this;
+		}
+	};
+
+	/**
+	 * Get the offset, within `Parameters`, of the value of each variable that is not fixed
+	 */
+	struct Offsetter : Variabler<Offsetter> {
+		using Variabler<Offsetter>::data;
+		const char* start;
+		std::vector<std::ptrdiff_t> offsets;
+
+		Offsetter(const Parameters& parameters):
+			start(reinterpret_cast<const char*>(&parameters)){}
+
+		template<class Distribution>
+		Offsetter& data(Variable<Distribution>& variable, const std::string& name){
+			offsets.push_back(reinterpret_cast<const char*>(&variable.value)-start);
+			return *this;
+		}
+	};
+
+	/**
+	 * Calculate prior likelihoods for values of an automatic differentiation type
+	 */
+	template<class Scalar>
+	struct ScalarLogliker : Variabler<ScalarLogliker<Scalar>> {
+		using Variabler<ScalarLogliker<Scalar>>::data;
+		const std::vector<Scalar>& values;
+		uint index = 0;
+		Scalar loglike = 0;
+
+		ScalarLogliker(const std::vector<Scalar>& values):
+			values(values){}
+
+		template<class Distribution>
+		ScalarLogliker& data(Variable<Distribution>& variable, const std::string& name){
+			loglike += variable.loglike(values[index]);
 			index++;
 			return *this;
 		}
@@ -125,7 +125,7 @@ public:
 	 * quadrants B,C or D back into A
 	 */
 	Mean kobe_to_a;
-		int kobe_out_a;
+	int kobe_out_a = 0;
 
 	/**
 	 * Baseline CPUE for regions/gears used to calculate relative
@@ -4,6 +4,7 @@
 
 #include "model.hpp"
 #include "data.hpp"
+#include "catches.hpp"
 
 namespace IOSKJ {
 
@@ -12,6 +13,22 @@ namespace IOSKJ {
  */
 class Procedure {
  public:
+    /**
+     * Set the replicate and procedure numbers whose random number streams
+     * are used for imprecision and implementation error (see `Generator::stream()`)
+     */
+    void streams(uint32_t replicate, uint32_t procedure){
+        replicate_ = replicate;
+        procedure_ = procedure;
+    }
+
+    /**
+     * Get the random number stream for a time and purpose
+     */
+    Philox stream(uint time, Purpose purpose) const {
+        return Generator.stream(replicate_,procedure_,time,purpose);
+    }
+
     virtual void reset(uint time, Model& model) {
 
     };
@@ -27,6 +44,10 @@ class Procedure {
     };
 
     virtual void write(std::ostream& stream) = 0;
+
+ private:
+    uint32_t replicate_ = 0;
+    uint32_t procedure_ = 0;
 };
 
 /**
@@ -91,12 +112,10 @@ public:
 class HistCatch : public Procedure, public Structure<HistCatch> {
 public:
 
-    Array<Variable<Fixed>,Year,Quarter,Region,Method> catches;
-
-    HistCatch(void){
-        // Read in historical catches (borrowed from parameters)
-        catches.read("parameters/input/catches.tsv",true);
-    }
+    /**
+     * Historical catches (shared with parameters)
+     */
+    CatchHistory catches;
 
     virtual void write(std::ostream& stream){
         stream
@@ -111,10 +130,9 @@ public:
         if(year>2014) year = 2014;
         uint quarter = IOSKJ::quarter(time);
         model.exploit = model.exploit_catch;
-        for(auto region : regions){
-            for(auto method : methods){
-                model.catches(region,method) = catches(year,quarter,region,method);
-            }
+        const double* catches_quarter = catches.quarter(year,quarter);
+        for(uint index=0;index<regions_size*methods_size;index++){
+            model.catches[index] = catches_quarter[index];
         }
     }
 };
@@ -150,7 +168,7 @@ public:
     }
 
     virtual void operate(uint time, Model& model){
-        model.catches_set(tac/4.0);
+        model.catches_set(tac/4.0,this->stream(time,purpose_implementation));
     }
 };
 
@@ -319,9 +337,10 @@ public:
                 // Apply imprecision to simulate stock
                 // assessment estimation
                 Lognormal imprecision(1,precision);
-                bcurr *= imprecision.random();
-                b0 *= imprecision.random();
-                etarg *= imprecision.random();
+                Philox stream = this->stream(time,purpose_imprecision);
+                bcurr *= imprecision.random(stream);
+                b0 *= imprecision.random(stream);
+                etarg *= imprecision.random(stream);
                 
                 double status = bcurr/b0;
                                 
@@ -354,7 +373,7 @@ public:
 
         // Apply catch limit with some implementation error
         if (not std::isnan(catches_now_)) {
-            model.catches_set(catches_now_,0.2);
+            model.catches_set(catches_now_,this->stream(time,purpose_implementation),0.2);
         }
     }
 
@@ -459,7 +478,8 @@ public:
             double b = model.biomass_status();
             // Add imprecision
             Lognormal imprecision(1,precision);
-            b *= imprecision.random();
+            Philox stream = this->stream(time,purpose_imprecision);
+            b *= imprecision.random(stream);
             // Calculate F
             double f;
             if(b<limit) f = 0;
@@ -548,7 +568,8 @@ public:
             double f = model.exploitation_rate_get();
             // Add imprecision
             Lognormal imprecision(1,precision);
-            f *= imprecision.random();
+            Philox stream = this->stream(time,purpose_imprecision);
+            f *= imprecision.random(stream);
             // Check to see if F is outside of range
             if(f<target-buffer or f>target+buffer){
                 // Calculate ratio between current estimated F and target
@@ -673,7 +694,8 @@ public:
             double cpue = combined;
             // Add observation error
             Lognormal imprecision(1,precision);
-            cpue *= imprecision.random();
+            Philox stream = this->stream(time,purpose_imprecision);
+            cpue *= imprecision.random(stream);
             // Update smoothed index
             if(index_==-1) index_ = cpue;
             else index_ = responsiveness*cpue + (1-responsiveness)*index_;
@@ -694,7 +716,7 @@ public:
             }
             last_ = tac;
             // Apply recommended TAC
-            model.catches_set(tac*1000/4);
+            model.catches_set(tac*1000/4,this->stream(time,purpose_implementation));
         }
     }
 
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "model.hpp"
+
+namespace IOSKJ {
+
+/**
+ * A cache of reference points
+ *
+ * Reference points depend only on the model attributes (and the `model_version`) hashed by
+ * `Model::equilibrium_hash()` so replicates which use the same parameter sample (and repeated evaluations) can reuse them
+ * rather than repeating the equilibrium solves in `Model::references_find()`.
+ * Thread safe so that it can be shared by worker threads.
+ */
+class References {
+public:
+
+	/**
+	 * Reference points for a single set of model attributes
+	 */
+	struct Values {
+		double msy;
+		double e_msy;
+		double f_msy;
+		double biomass_spawners_msy;
+		double e_40;
+		double f_40;
+		double biomass_spawners_40;
+	};
+
+	/**
+	 * Number of times reference points were found in the cache
+	 */
+	std::atomic<uint> hits {0};
+
+	/**
+	 * Set the reference points of a model, from the cache if possible,
+	 * otherwise by calling `Model::references_find()`
+	 */
+	void find(Model& model){
+		uint64_t hash = model.equilibrium_hash();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto iter = values_.find(hash);
+			if(iter!=values_.end()){
+				const Values& values = iter->second;
+				model.msy = values.msy;
+				model.e_msy = values.e_msy;
+				model.f_msy = values.f_msy;
+				model.biomass_spawners_msy = values.biomass_spawners_msy;
+				model.e_40 = values.e_40;
+				model.f_40 = values.f_40;
+				model.biomass_spawners_40 = values.biomass_spawners_40;
+				model.references_trials = 0;
+				hits++;
+				return;
+			}
+		}
+		model.references_find();
+		std::lock_guard<std::mutex> lock(mutex_);
+		values_[hash] = {
+			model.msy,
+			model.e_msy,
+			model.f_msy,
+			model.biomass_spawners_msy,
+			model.e_40,
+			model.f_40,
+			model.biomass_spawners_40
+		};
+	}
+
+	/**
+	 * Number of cached reference points
+	 */
+	uint size(void) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return values_.size();
+	}
+
+	/**
+	 * Read cached reference points from a file (if it exists)
+	 */
+	void read(const std::string& path){
+		std::ifstream file(path);
+		if(not file.good()) return;
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::string line;
+		std::getline(file,line);
+		while(std::getline(file,line)){
+			// Values are parsed with `std::strtod` (rather than `>>`) so that
+			// any "nan" values are read back
+			std::vector<std::string> fields;
+			std::istringstream stream(line);
+			std::string field;
+			while(std::getline(stream,field,'\t')) fields.push_back(field);
+			if(fields.size()!=8) throw std::runtime_error("Error reading reference points cache: "+path);
+			double value[7];
+			for(uint index=0;index<7;index++) value[index] = std::strtod(fields[index+1].c_str(),nullptr);
+			uint64_t hash = std::strtoull(fields[0].c_str(),nullptr,16);
+			values_[hash] = {value[0],value[1],value[2],value[3],value[4],value[5],value[6]};
+		}
+	}
+
+	/**
+	 * Write cached reference points to a file
+	 *
+	 * Values are written at full precision so that cached reference points
+	 * are identical to calculated ones. The file is written to a temporary and then renamed
+	 * so that an aborted write does not leave a truncated cache.
+	 */
+	void write(const std::string& path){
+		std::string temp = path+".tmp";
+		{
+			std::ofstream file(temp);
+			file<<"hash\tmsy\te_msy\tf_msy\tb_msy\te_40\tf_40\tb_40\n";
+			file.precision(17);
+			std::lock_guard<std::mutex> lock(mutex_);
+			for(const auto& item : values_){
+				const Values& values = item.second;
+				file<<std::hex<<item.first<<std::dec<<"\t"
+					<<values.msy<<"\t"<<values.e_msy<<"\t"<<values.f_msy<<"\t"<<values.biomass_spawners_msy<<"\t"
+					<<values.e_40<<"\t"<<values.f_40<<"\t"<<values.biomass_spawners_40<<"\n";
+			}
+		}
+		boost::filesystem::rename(temp,path);
+	}
+
+private:
+	std::map<uint64_t,Values> values_;
+	std::mutex mutex_;
+};
+
+}
@@ -45,7 +45,8 @@ evaluate <- function(procedures,replicates=1,samples_file="feasible/output/accep
 	}
 
 	write.table(procedures,row.names=F,col.names=T,quote=F,file="procedures/input/procedures.tsv")
-	system(paste('./ioskj.exe evaluate_wrap',replicates,samples_file,year_start))
+	if(!file.exists(paste0(samples_file,'.snapshots'))) system(paste('./ioskj.exe snapshots',samples_file))
+	system(paste('./ioskj.exe evaluate_wrap',replicates,samples_file,year_start,'--references-cache'))
 
 	if(dir!='.') setwd(cwd)
 	read_track()
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "model.hpp"
+#include "parameters.hpp"
+
+namespace IOSKJ {
+
+/**
+ * A store of model states at the end of the deterministic part of the hindcast
+ * for each row of a parameter samples file
+ *
+ * Up until the first year after the recruitment deviation years, the hindcast uses no random numbers
+ * so the model state for a sample row is the same for all replicates and seeds. The store holds these
+ * states so that `evaluate` only needs to simulate the remaining quarters up to the start of the evaluation
+ * (with replicate specific random number streams).
+ *
+ * The store is a binary file: a `Header` followed by one `Model` for each row. It is memory mapped when read
+ * so that models are copied directly from the file. The header includes a hash of the samples and parameter
+ * input files, and the `model_version`, so that a store is not used if those have changed since it was built.
+ */
+class Snapshots {
+public:
+
+	/**
+	 * Time of the snapshots: the first quarter which uses random recruitment
+	 */
+	static uint time(void){
+		return time_calc(recdev_years.end(),0);
+	}
+
+	/**
+	 * Path of the store for a samples file
+	 */
+	static std::string path(const std::string& samples_file){
+		return samples_file+".snapshots";
+	}
+
+	/**
+	 * Build the store for a samples file
+	 */
+	static void build(const std::string& samples_file, const Parameters& parameters){
+		Frame samples_frame;
+		samples_frame.read(samples_file);
+		Parameters::Rows samples(samples_frame);
+
+		Header header = header_make(samples_file);
+		header.rows = samples.rows();
+
+		std::string temp = path(samples_file)+".tmp";
+		{
+			std::ofstream file(temp,std::ios::binary);
+			file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+			for(uint row=0;row<header.rows;row++){
+				Parameters parameters_row = parameters;
+				parameters_row.read(samples,row);
+				Model model;
+				for(uint time=0;time<Snapshots::time();time++){
+					parameters_row.set(time,model);
+					// No random numbers are used before the snapshot time so the replicate does not matter
+					model.update(time,0);
+				}
+				file.write(reinterpret_cast<const char*>(&model),sizeof(model));
+			}
+			if(not file.good()) throw std::runtime_error("Error writing snapshots: "+temp);
+		}
+		boost::filesystem::rename(temp,path(samples_file));
+	}
+
+	/**
+	 * Open the store for a samples file
+	 *
+	 * If the store does not exist, or is out of date, then `valid()` will be false.
+	 */
+	void open(const std::string& samples_file){
+		std::string store = path(samples_file);
+		if(not boost::filesystem::exists(store)) return;
+		if(boost::filesystem::file_size(store)<sizeof(Header)) return;
+
+		using namespace boost::interprocess;
+		file_ = file_mapping(store.c_str(),read_only);
+		region_ = mapped_region(file_,read_only);
+
+		const Header& header = *static_cast<const Header*>(region_.get_address());
+		Header expected = header_make(samples_file);
+		rows_ = 0;
+		if(
+			std::memcmp(header.magic,expected.magic,sizeof(header.magic))==0 and
+			header.version==expected.version and
+			header.model_version==expected.model_version and
+			header.model_size==expected.model_size and
+			header.time==expected.time and
+			header.inputs_hash==expected.inputs_hash and
+			region_.get_size()==sizeof(Header)+header.rows*sizeof(Model)
+		) rows_ = header.rows;
+	}
+
+	/**
+	 * Is the store valid (i.e. it exists and is up to date)?
+	 */
+	bool valid(void) const {
+		return rows_>0;
+	}
+
+	/**
+	 * Copy the snapshot for a row into a model
+	 */
+	void get(uint row, Model& model) const {
+		if(row>=rows_) throw std::runtime_error("Snapshot row out of range: "+std::to_string(row));
+		const char* start = static_cast<const char*>(region_.get_address()) + sizeof(Header) + row*sizeof(Model);
+		std::memcpy(static_cast<void*>(&model),start,sizeof(Model));
+	}
+
+private:
+
+	static_assert(
+		std::is_trivially_copyable<Model>::value,
+		"Models are stored in snapshots as raw bytes so must be trivially copyable"
+	);
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t model_version;
+		uint32_t model_size;
+		uint32_t time;
+		uint32_t rows;
+		uint32_t padding;
+		uint64_t inputs_hash;
+	};
+
+	static Header header_make(const std::string& samples_file){
+		Header header;
+		std::memcpy(header.magic,"IOSKJSNP",8);
+		header.version = 2;
+		header.model_version = model_version;
+		header.model_size = sizeof(Model);
+		header.time = time();
+		header.rows = 0;
+		header.padding = 0;
+		// FNV-1a hash of input files
+		uint64_t hash = 14695981039346656037ull;
+		for(std::string input : {
+			samples_file,
+			std::string("parameters/input/parameters.json"),
+			std::string("parameters/input/recruits_deviations.tsv"),
+			std::string("parameters/input/selectivities.tsv"),
+			std::string("parameters/input/catches.tsv")
+		}){
+			std::ifstream file(input,std::ios::binary);
+			char byte;
+			while(file.get(byte)){
+				hash ^= static_cast<unsigned char>(byte);
+				hash *= 1099511628211ull;
+			}
+		}
+		header.inputs_hash = hash;
+		return header;
+	}
+
+	boost::interprocess::file_mapping file_;
+	boost::interprocess::mapped_region region_;
+	uint rows_ = 0;
+};
+
+}
@@ -1,94 +1,556 @@
 #define BOOST_TEST_MODULE tests
 #include <boost/test/unit_test.hpp>
 
+#include "imports.hpp"
+#include "dimensions.hpp"
 #include "model.hpp"
+#include "parameters.hpp"
+#include "data.hpp"
+#include "batch.hpp"
+#include "laplace.hpp"
 
 using namespace IOSKJ;
 
+/**
+ * Are two values identical (including both being NaN, e.g. for a CPUE
+ * which is not calculated in a year)?
+ */
+bool identical(double a, double b){
+	return a==b or (std::isnan(a) and std::isnan(b));
+}
+
+/**
+ * Get a model initialised using the parameter values in "parameters/input"
+ */
+Model model_initialised(void){
+	Parameters parameters;
+	parameters.read();
+	Model model;
+	parameters.set(0,model);
+	return model;
+}
+
 BOOST_AUTO_TEST_SUITE(model)
 
 	/**
 	 * @class IOSKJ::Model
 	 * @test equilibrium_stable
-	 * 
+	 *
 	 * Test that when there is no substantial change in equilibrium
 	 * conditions given further simulation.
 	 */
 	BOOST_AUTO_TEST_CASE(equilibrium_stable){
-		Model model;
-		model.track_open("equilibrium_stable.txt");
+		Model model = model_initialised();
+		model.recruits_relation_on = false;
+		model.recruits_variation_on = false;
+		model.exploit = Model::exploit_none;
+		model.equilibrium();
 
-		model.inititialise();
+		// Biomass is calculated at the start of each update so compare
+		// the first quarter of the first and last years
+		model.update(0,0);
 		auto biomass_equil = model.biomass;
+		for(uint time=1;time<=100*4;time++) model.update(time,0);
+
+		const double tolerance = 0.01; //0.01%
+		BOOST_CHECK_CLOSE(biomass_equil(WE),model.biomass(WE),tolerance);
+		BOOST_CHECK_CLOSE(biomass_equil(MA),model.biomass(MA),tolerance);
+		BOOST_CHECK_CLOSE(biomass_equil(EA),model.biomass(EA),tolerance);
+	}
 
+	/**
+	 * @class IOSKJ::Model
+	 * @test equilibrium_unfished
+	 *
+	 * Test that the directly calculated unfished equilibrium is the
+	 * same as that found by iterating `update()`
+	 */
+	BOOST_AUTO_TEST_CASE(equilibrium_unfished){
+		Model model = model_initialised();
+		model.recruits_relation_on = false;
 		model.recruits_variation_on = false;
-		model.exploitation_on = false;
-		model.years(0,100);
+		model.recruits_multiplier = 1;
+		model.exploit = Model::exploit_none;
 
-		const double tolerance = 0.01; //0.01%
-		BOOST_CHECK_CLOSE(biomass_equil(W),model.biomass(W),tolerance);
-		BOOST_CHECK_CLOSE(biomass_equil(M),model.biomass(M),tolerance);
-		BOOST_CHECK_CLOSE(biomass_equil(E),model.biomass(E),tolerance);
+		model.equilibrium_unfished();
+		auto numbers_direct = model.numbers;
+		model.equilibrium();
+
+		const double tolerance = 1e-6; //1e-6%
+		for(auto region : regions){
+			for(auto age : ages){
+				BOOST_CHECK_CLOSE(numbers_direct(region,age),model.numbers(region,age),tolerance);
+			}
+		}
+	}
+
+	/**
+	 * @class IOSKJ::Model
+	 * @test equilibrium_warm
+	 *
+	 * Test that an equilibrium found by warm starting from the equilibrium
+	 * for a different exploitation rate is the same as that found from a cold start
+	 */
+	BOOST_AUTO_TEST_CASE(equilibrium_warm){
+		Model cold = model_initialised();
+		Model warm = cold;
+
+		cold.exploitation_rate_set(0.3);
+		cold.equilibrium();
+
+		warm.exploitation_rate_set(0.1);
+		warm.equilibrium();
+		warm.exploitation_rate_set(0.3);
+		warm.equilibrium(true);
+
+		// Convergence is tested on biomass so numbers in partitions with
+		// little biomass are not as close
+		const double tolerance = 1e-7; //1e-7%
+		const double tolerance_numbers = 1e-5; //1e-5%
+		for(auto region : regions){
+			BOOST_CHECK_CLOSE(warm.biomass(region),cold.biomass(region),tolerance);
+			for(auto method : methods){
+				BOOST_CHECK_CLOSE(warm.catches_taken(region,method),cold.catches_taken(region,method),tolerance);
+			}
+			for(auto age : ages){
+				BOOST_CHECK_CLOSE(warm.numbers(region,age),cold.numbers(region,age),tolerance_numbers);
+			}
+		}
 	}
 
 	/**
 	 * @class IOSKJ::Model
 	 * @test equilibrium_uniform
-	 * 
+	 *
 	 * Test that when there is no movement and equal
 	 * reruitment distribution that the equilibrium biomass
 	 * is equal in all areas
 	 */
 	BOOST_AUTO_TEST_CASE(equilibrium_uniform){
-		Model model;
-		model.recruits_uniform();
-		model.movement_none();
+		Model model = model_initialised();
+		for(auto region_from : region_froms){
+			for(auto region : regions) model.movement_region(region_from,region) = 0;
+		}
+		model.biomass_spawners_unfished = 1e6;
 		model.initialise();
 
 		const double tolerance = 0.01; //0.01%
-		BOOST_CHECK_CLOSE(model.biomass(W),model.biomass(M),tolerance);
-		BOOST_CHECK_CLOSE(model.biomass(M),model.biomass(E),tolerance);
-		BOOST_CHECK_CLOSE(model.biomass(W),model.biomass(E),tolerance);
+		BOOST_CHECK_CLOSE(model.biomass(WE),model.biomass(MA),tolerance);
+		BOOST_CHECK_CLOSE(model.biomass(MA),model.biomass(EA),tolerance);
+		BOOST_CHECK_CLOSE(model.biomass(WE),model.biomass(EA),tolerance);
 	}
 
 	/**
 	 * @class IOSKJ::Model
 	 * @test recruiment_variation
-	 * 
-	 * Test that recruitment variation has the right mean and 
+	 *
+	 * Test that recruitment variation has the right mean and
 	 * standard deviation.
 	 */
 	BOOST_AUTO_TEST_CASE(recruiment_variation){
-		Model model;
-		model.track_open("recruiment_variation.txt");
+		Model model = model_initialised();
 
-		model.initialise();
-		
-		model.exploitation_on = false;
-		Stats stats;
-		for(int year=0;year<1000;year++){
-			model.year(year);
-			stats(model.recruits_deviation);
+		model.exploit = Model::exploit_none;
+		model.recruits_variation_on = true;
+		Generator.seed(1);
+		const uint years = 10000;
+		double multipliers = 0;
+		double deviations = 0;
+		for(uint year=0;year<years;year++){
+			model.update(year*4,0);
+			multipliers += model.recruits_multiplier;
+			deviations += std::pow(model.recruits_deviation,2);
 		}
 
-		BOOST_CHECK_CLOSE(mean(stats),1,5);
-		BOOST_CHECK_CLOSE(std::pow(variance(stats),0.5),model.recruits_sd,10);
+		BOOST_CHECK_CLOSE(multipliers/years,1,5);
+		BOOST_CHECK_CLOSE(std::sqrt(deviations/years),model.recruits_sd,10);
 	}
 
 	/**
 	 * @class IOSKJ::Model
 	 * @test exploitation_specified
-	 * 
+	 *
+	 * Test that when exploitation rates are specified they are applied
+	 * to the vulnerable biomass
 	 */
 	BOOST_AUTO_TEST_CASE(exploitation_specified){
-		Model model;
-		model.track_open("exploitation_specified.txt");
-
-		model.initialise();
+		Model model = model_initialised();
 
 		model.recruits_variation_on = false;
-		model.exploitation_rate_set(0);
-		model.years(0,20);
+		model.exploitation_rate_set(0.2);
+		for(uint time=0;time<20*4;time++) model.update(time,0);
+
+		for(auto region : regions){
+			for(auto method : methods){
+				BOOST_CHECK_EQUAL(model.exploitation_rate(region,method),model.exploitation_rate_specified(region,method));
+				BOOST_CHECK_EQUAL(model.catches_taken(region,method),model.exploitation_rate(region,method)*model.biomass_vulnerable(region,method));
+			}
+		}
+	}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(batch)
+
+	/**
+	 * @class IOSKJ::ModelBatch
+	 * @test batch_scalar
+	 *
+	 * Test that each lane of a batch gives exactly the same results as a scalar
+	 * model for a number of parameter sets (including a partially filled batch), over the
+	 * hindcast and some years of random recruitment
+	 */
+	BOOST_AUTO_TEST_CASE(batch_scalar){
+		const uint lanes = 4;
+		const uint count = 6;
+		Parameters parameters;
+		parameters.read();
+		Generator.seed(1);
+		std::vector<Parameters> parameters_sets;
+		while(parameters_sets.size()<count){
+			parameters.randomise();
+			// Skip parameter sets which can not be initialised
+			try {
+				Model model;
+				parameters.set(0,model);
+			} catch(...){
+				continue;
+			}
+			parameters_sets.push_back(parameters);
+		}
+
+		std::unique_ptr<ModelBatch<lanes>> batch(new ModelBatch<lanes>());
+		for(uint first=0;first<count;first+=lanes){
+			uint used = std::min(lanes,count-first);
+			std::vector<Model> scalars(used);
+			std::vector<Model> lanes_models(used);
+			for(uint time=0;time<=time_calc(2024,3);time++){
+				for(uint lane=0;lane<used;lane++){
+					uint32_t replicate = first+lane;
+					parameters_sets[first+lane].set(time,scalars[lane]);
+					scalars[lane].update(time,replicate);
+
+					parameters_sets[first+lane].set(time,lanes_models[lane]);
+					if(time==0) batch->load(lane,lanes_models[lane],replicate);
+					else batch->inputs(lane,lanes_models[lane]);
+				}
+				batch->update(time);
+				for(uint lane=0;lane<used;lane++){
+					const Model& scalar = scalars[lane];
+					Model& model = lanes_models[lane];
+					batch->store(lane,model);
+					BOOST_REQUIRE(identical(model.recruits_deviation,scalar.recruits_deviation));
+					for(auto region : regions){
+						BOOST_REQUIRE(identical(model.recruits(region),scalar.recruits(region)));
+						BOOST_REQUIRE(identical(model.biomass_spawners(region),scalar.biomass_spawners(region)));
+						for(auto age : ages){
+							BOOST_REQUIRE(identical(model.numbers(region,age),scalar.numbers(region,age)));
+						}
+						for(auto method : methods){
+							BOOST_REQUIRE(identical(model.catches_taken(region,method),scalar.catches_taken(region,method)));
+							BOOST_REQUIRE(identical(model.cpue(region,method),scalar.cpue(region,method)));
+							BOOST_REQUIRE(identical(model.catchability(region,method),scalar.catchability(region,method)));
+						}
+					}
+				}
+			}
+		}
+	}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(distributions)
+
+	/**
+	 * @class Utilities::Distributions::Philox
+	 * @test philox_known_answers
+	 *
+	 * Test that the generator gives the known answers for Philox4x32-10
+	 * published with the Random123 library. The first word of the key is the seed, the second
+	 * and the first three words of the counter address the stream, and the last word
+	 * of the counter is the block within the stream.
+	 */
+	BOOST_AUTO_TEST_CASE(philox_known_answers){
+		struct {
+			uint32_t counter[4];
+			uint32_t key[2];
+			uint32_t answer[4];
+		} vectors[] = {
+			{
+				{0x00000000,0x00000000,0x00000000,0x00000000},
+				{0x00000000,0x00000000},
+				{0x6627e8d5,0xe169c58d,0xbc57ac4c,0x9b00dbd8}
+			},{
+				{0xffffffff,0xffffffff,0xffffffff,0xffffffff},
+				{0xffffffff,0xffffffff},
+				{0x408f276d,0x41c83b0e,0xa20bc7c6,0x6d5451fd}
+			},{
+				{0x243f6a88,0x85a308d3,0x13198a2e,0x03707344},
+				{0xa4093822,0x299f31d0},
+				{0xd16cfe09,0x94fdcceb,0x5001e420,0x24126ea1}
+			}
+		};
+		for(const auto& vector : vectors){
+			Philox stream = Philox(vector.key[0]).stream(
+				vector.key[1],vector.counter[0],vector.counter[1],vector.counter[2]
+			);
+			stream.discard(4ull*vector.counter[3]);
+			for(uint index=0;index<4;index++) BOOST_CHECK_EQUAL(stream(),vector.answer[index]);
+		}
+	}
+
+	/**
+	 * @class Utilities::Distributions::FournierRobustifiedMultivariateNormal
+	 * @test fournier_block
+	 *
+	 * Test that the log-likelihood of a block is the same as the sum of the
+	 * scalar log-likelihoods including terms which are not valid (missing
+	 * proportions, zero sample sizes, missing expected values) and sample sizes
+	 * above the maximum
+	 */
+	BOOST_AUTO_TEST_CASE(fournier_block){
+		const uint count = 101;
+		const double max_size = 1000;
+		std::vector<double> proportions(count), sizes(count), expected(count);
+		Generator.seed(1);
+		Uniform uniform(0,1);
+		for(uint index=0;index<count;index++){
+			proportions[index] = uniform.random();
+			sizes[index] = uniform.random()*2*max_size;
+			expected[index] = uniform.random();
+			if(index%7==0) proportions[index] = NAN;
+			if(index%11==0) sizes[index] = 0;
+			if(index%13==0) expected[index] = NAN;
+		}
+
+		double sum = 0;
+		for(uint index=0;index<count;index++){
+			FournierRobustifiedMultivariateNormal distrib(proportions[index],sizes[index],max_size);
+			if(distrib.valid() and not std::isnan(expected[index])) sum += distrib.loglike(expected[index]);
+		}
+		double block = FournierRobustifiedMultivariateNormal::loglike(
+			count,proportions.data(),sizes.data(),expected.data(),max_size
+		);
+
+		BOOST_CHECK(std::isfinite(block));
+		BOOST_CHECK_CLOSE(block,sum,1e-10); //1e-10%
+	}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+/**
+ * A minimal forward mode automatic differentiation type used to check that
+ * the templated model, data and parameters can be instantiated with a type other than `double`
+ */
+namespace AD {
+
+struct Dual {
+	double value = 0;
+	double deriv = 0;
+
+	Dual(void){}
+	Dual(double value, double deriv = 0):value(value),deriv(deriv){}
+
+	Dual& operator+=(const Dual& other){
+		value += other.value;
+		deriv += other.deriv;
+		return *this;
+	}
+	Dual& operator-=(const Dual& other){
+		value -= other.value;
+		deriv -= other.deriv;
+		return *this;
+	}
+	Dual& operator*=(const Dual& other){
+		deriv = deriv*other.value + value*other.deriv;
+		value *= other.value;
+		return *this;
+	}
+	Dual& operator/=(const Dual& other){
+		deriv = (deriv*other.value - value*other.deriv)/(other.value*other.value);
+		value /= other.value;
+		return *this;
+	}
+	Dual operator-(void) const {
+		return Dual(-value,-deriv);
+	}
+};
+
+inline Dual operator+(Dual a, const Dual& b){ return a += b; }
+inline Dual operator-(Dual a, const Dual& b){ return a -= b; }
+inline Dual operator*(Dual a, const Dual& b){ return a *= b; }
+inline Dual operator/(Dual a, const Dual& b){ return a /= b; }
+inline Dual operator+(Dual a, double b){ return a += Dual(b); }
+inline Dual operator-(Dual a, double b){ return a -= Dual(b); }
+inline Dual operator*(Dual a, double b){ return a *= Dual(b); }
+inline Dual operator/(Dual a, double b){ return a /= Dual(b); }
+inline Dual operator+(double a, const Dual& b){ return Dual(a) + b; }
+inline Dual operator-(double a, const Dual& b){ return Dual(a) - b; }
+inline Dual operator*(double a, const Dual& b){ return Dual(a) * b; }
+inline Dual operator/(double a, const Dual& b){ return Dual(a) / b; }
+
+#define DUAL_COMPARE(op) \
+	inline bool operator op(const Dual& a, const Dual& b){ return a.value op b.value; } \
+	inline bool operator op(const Dual& a, double b){ return a.value op b; } \
+	inline bool operator op(double a, const Dual& b){ return a op b.value; }
+DUAL_COMPARE(<)
+DUAL_COMPARE(>)
+DUAL_COMPARE(<=)
+DUAL_COMPARE(>=)
+DUAL_COMPARE(==)
+DUAL_COMPARE(!=)
+#undef DUAL_COMPARE
+
+inline Dual exp(const Dual& a){
+	double value = std::exp(a.value);
+	return Dual(value,value*a.deriv);
+}
+inline Dual log(const Dual& a){
+	return Dual(std::log(a.value),a.deriv/a.value);
+}
+inline Dual sqrt(const Dual& a){
+	double value = std::sqrt(a.value);
+	return Dual(value,a.deriv/(2*value));
+}
+inline Dual fabs(const Dual& a){
+	return a.value<0?-a:a;
+}
+inline Dual pow(const Dual& a, double b){
+	return Dual(std::pow(a.value,b),b*std::pow(a.value,b-1)*a.deriv);
+}
+inline Dual pow(const Dual& a, const Dual& b){
+	double value = std::pow(a.value,b.value);
+	return Dual(value,value*(b.deriv*std::log(a.value)+b.value*a.deriv/a.value));
+}
+inline Dual pow(double a, const Dual& b){
+	double value = std::pow(a,b.value);
+	return Dual(value,value*std::log(a)*b.deriv);
+}
+inline Dual erfc(const Dual& a){
+	return Dual(std::erfc(a.value),-2/std::sqrt(M_PI)*std::exp(-a.value*a.value)*a.deriv);
+}
+inline double scalar_value(const Dual& a){
+	return a.value;
+}
+
+}
+
+/**
+ * Calculate the log-likelihood of parameter values over the conditioning period
+ * using a model and data templated on `Scalar`
+ */
+template<class Scalar>
+Scalar loglike_scalar(const Parameters& parameters, const Data& data_, const std::vector<Scalar>& values){
+	ModelType<Scalar> model;
+	DataType<Scalar> data(data_);
+	for(uint time=0;time<=time_calc(2014,3);time++){
+		parameters.set(time,model,values);
+		model.update(time,0);
+		data.get(time,model);
+	}
+	return parameters.loglike(values)+data.loglike();
+}
+
+BOOST_AUTO_TEST_SUITE(differentiation)
+
+	/**
+	 * @class IOSKJ::ModelType
+	 * @test dual
+	 *
+	 * Test that `ModelType`, `DataType` and `Parameters::set()` instantiated with
+	 * an automatic differentiation type give the same log-likelihood as `Model` and `Data`
+	 * and derivatives which agree with finite differences
+	 */
+	BOOST_AUTO_TEST_CASE(dual){
+		Parameters parameters;
+		parameters.read();
+		Data data;
+		data.read();
+		auto values = parameters.vector();
+
+		// Log-likelihood using `double` (as when conditioning)
+		double loglike;
+		{
+			Parameters parameters_ = parameters;
+			Data data_ = data;
+			Model model;
+			for(uint time=0;time<=time_calc(2014,3);time++){
+				parameters_.set(time,model);
+				model.update(time,0);
+				data_.get(time,model);
+			}
+			loglike = parameters_.loglike()+data_.loglike();
+		}
+		BOOST_CHECK_EQUAL(loglike_scalar<double>(parameters,data,values),loglike);
+
+		for(uint index : {0u,1u,3u,10u,20u,uint(values.size()-1)}){
+			std::vector<AD::Dual> duals(values.begin(),values.end());
+			duals[index].deriv = 1;
+			auto result = loglike_scalar<AD::Dual>(parameters,data,duals);
+			BOOST_CHECK_EQUAL(result.value,loglike);
+
+			double step = 1e-6*std::max(1.0,std::fabs(values[index]));
+			auto upper = values;
+			auto lower = values;
+			upper[index] += step;
+			lower[index] -= step;
+			double deriv = (loglike_scalar<double>(parameters,data,upper)-loglike_scalar<double>(parameters,data,lower))/(2*step);
+			BOOST_CHECK_CLOSE(result.deriv,deriv,1e-4); //1e-4%
+		}
+	}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(conditioning)
+
+	/**
+	 * @class IOSKJ::Laplace
+	 * @test laplace_bounds
+	 *
+	 * Test that a parameter at a bound (and so excluded from the Hessian) has zero variance
+	 * and covariances, that only a parameter for which the Hessian is not positive definite has
+	 * undefined covariances, and that the covariances of the other parameters are the inverse of the Hessian
+	 */
+	BOOST_AUTO_TEST_CASE(laplace_bounds){
+		// Five parameters, the third of which is at a bound
+		std::vector<double> scales = {1,2,0.5,3,10};
+		std::vector<uint> included = {0,1,3,4};
+		// Hessian (in scaled units) which is not positive definite for the last parameter
+		std::vector<std::vector<double>> hessian = {
+			{4,1,0.5,0},
+			{1,3,0.2,0},
+			{0.5,0.2,2,0},
+			{0,0,0,-1}
+		};
+		Laplace laplace(hessian,included,scales);
+		const auto& covariance = laplace.covariance;
+
+		BOOST_CHECK(laplace.kept==std::vector<uint>({0,1,2}));
+		BOOST_CHECK(laplace.dropped==std::vector<uint>({3}));
+
+		for(uint column : {0,1,2,3}){
+			BOOST_CHECK_EQUAL(covariance[2][column],0);
+			BOOST_CHECK_EQUAL(covariance[column][2],0);
+		}
+		for(uint column=0;column<scales.size();column++){
+			BOOST_CHECK(std::isnan(covariance[4][column]));
+			BOOST_CHECK(std::isnan(covariance[column][4]));
+		}
+
+		// Covariances of kept parameters (converted to scaled units) times
+		// the Hessian is the identity matrix
+		for(uint row=0;row<3;row++){
+			for(uint col=0;col<3;col++){
+				double product = 0;
+				for(uint k=0;k<3;k++){
+					uint first = included[row];
+					uint second = included[k];
+					BOOST_REQUIRE(std::isfinite(covariance[first][second]));
+					product += covariance[first][second]/(scales[first]*scales[second])*hessian[k][col];
+				}
+				BOOST_CHECK_SMALL(product-(row==col?1:0),1e-12);
+			}
+		}
 	}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -61,9 +61,17 @@ struct Tracker {
 	}
 
 	void get(int replicate, int procedure, int time, const Model& model){
+		get(file,replicate,procedure,time,model);
+	}
+
+	/**
+	 * Get model variables into a stream other than the tracking file
+	 * e.g. a buffer filled by a worker thread and written out later
+	 */
+	static void get(std::ostream& stream, int replicate, int procedure, int time, const Model& model){
 		uint year = IOSKJ::year(time);
 		uint quarter = IOSKJ::quarter(time);
-		file
+		stream
 			<<replicate<<"\t"
 			<<procedure<<"\t"
 			<<year<<"\t"
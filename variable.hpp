@@ -1,23 +1,41 @@
 #pragma once
 
-template<class Distribution>
-class Variable : public Distribution, public Structure<Variable<Distribution>> {
+/**
+ * A variable having a value and a probability distribution
+ *
+ * The type of the value defaults to `double` but may be an automatic differentiation type
+ * (see `ModelType`) so that the log-likelihood of model predictions can be differentiated.
+ */
+template<class Distribution, class Scalar = double>
+class Variable : public Distribution, public Structure<Variable<Distribution,Scalar>> {
 public:
 
-    using Structure<Variable<Distribution>>::derived;
-    using Structure<Variable<Distribution>>::derived_nullptr;
+    using Structure<Variable<Distribution,Scalar>>::derived;
+    using Structure<Variable<Distribution,Scalar>>::derived_nullptr;
 
-    double value = NAN;
+    Scalar value = NAN;
+
+    Variable(void){}
+
+    /**
+     * Construct from a variable with a different type of value (e.g.
+     * to get a copy of data with automatic differentiation values)
+     */
+    template<class Other>
+    explicit Variable(const Variable<Distribution,Other>& other):
+        Distribution(other),
+        value(scalar_value(other.value)){
+    }
 
     bool is_na(void) const {
-        return std::isnan(value);
+        return std::isnan(scalar_value(value));
     }
 
-	operator double(void) const {
+	operator Scalar(void) const {
 		return value;
 	}
 
-    #define OP_(op) void operator op(const double& other){ value op other; }
+    #define OP_(op) void operator op(const Scalar& other){ value op other; }
         OP_(=)
         OP_(+=)
         OP_(-=)
@@ -25,13 +43,25 @@ public:
         OP_(/=)
     #undef OP_
 
-    double loglike(void) const {
+    Scalar loglike(void) const {
         if(not is_na() and Distribution::valid()){
             return Distribution::loglike(value);
         }
         return 0;
     }
 
+    /**
+     * Log-likelihood of some other value (e.g. an automatic 
+     * differentiation value of a parameter) given this variable's distribution
+     */
+    template<class Other>
+    Other loglike(const Other& other) const {
+        if(not std::isnan(scalar_value(other)) and Distribution::valid()){
+            return Distribution::loglike(other);
+        }
+        return 0;
+    }
+
     template<class Mirror>
     void reflect(Mirror& mirror) {
         mirror